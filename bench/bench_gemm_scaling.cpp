@@ -0,0 +1,62 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <matrix.hpp>
+
+using namespace nanoblas;
+
+
+/*
+  Strong scaling of the native matrix-matrix product C = A*B
+
+  usage: bench_gemm_scaling [n] [maxthreads]
+*/
+
+int main (int argc, char ** argv)
+{
+  size_t n = (argc > 1) ? std::stoul(argv[1]) : 2000;
+  size_t maxthreads = (argc > 2) ? std::stoul(argv[2]) : TaskManager::DefaultNumThreads();
+
+  Matrix<double,RowMajor> A(n,n), B(n,n), C(n,n);
+  for (size_t i = 0; i < n; i++)
+    for (size_t j = 0; j < n; j++)
+      {
+        A(i,j) = 1.0 / (1+i+j);
+        B(i,j) = double(i) - double(j);
+      }
+
+  std::vector<size_t> threads;
+  for (size_t t = 1; t < maxthreads; t *= 2)
+    threads.push_back(t);
+  threads.push_back(maxthreads);
+
+  std::cout << "n = " << n << std::endl;
+  std::cout << std::setw(8) << "threads" << std::setw(12) << "time[s]"
+            << std::setw(12) << "GFlop/s" << std::setw(10) << "speedup"
+            << std::setw(12) << "efficiency" << std::endl;
+
+  double time1 = 0;
+  for (size_t t : threads)
+    {
+      SetNumThreads(t);
+      C = A*B;   // warm-up
+
+      double best = 1e99;
+      for (int rep = 0; rep < 3; rep++)
+        {
+          auto start = std::chrono::steady_clock::now();
+          C = A*B;
+          auto end = std::chrono::steady_clock::now();
+          best = std::min(best, std::chrono::duration<double>(end-start).count());
+        }
+      if (t == 1) time1 = best;
+
+      double gflops = 2e-9 * n*n*n / best;
+      std::cout << std::setw(8) << t << std::setw(12) << best
+                << std::setw(12) << gflops << std::setw(10) << time1/best
+                << std::setw(12) << time1/best/t << std::endl;
+    }
+}
@@ -0,0 +1,250 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <functional>
+#include <cmath>
+
+#include <vector.hpp>
+#include <matrix.hpp>
+#include <inverse.hpp>
+#include <lu.hpp>
+#include <cholesky.hpp>
+#include <lapack_interface.hpp>
+
+using namespace nanoblas;
+
+
+/*
+  Benchmark suite of nanoblas kernels
+
+  Every case is run once for warm-up, then timed repeatedly until both
+  a minimal number of repetitions and a minimal total time are reached.
+  Short kernels are repeated in batches of at least 1 ms per sample.
+  Rates are computed from the median sample.
+
+  usage: nanoblas_bench [--quick] [--filter name] [--json file]
+                        [--reps n] [--mintime seconds]
+*/
+
+
+struct Options
+{
+  bool quick = false;
+  std::string filter;
+  std::string json;
+  size_t reps = 5;
+  double mintime = 0.2;
+};
+
+struct Result
+{
+  std::string name;
+  size_t n;
+  size_t samples;
+  double tmin, tmedian, tmean, tstddev;   // seconds per call
+  double flops, bytes;                    // per call
+
+  double GFlops() const { return flops / tmedian * 1e-9; }
+  double GBytes() const { return bytes / tmedian * 1e-9; }
+};
+
+
+class Bench
+{
+  Options m_opts;
+  std::vector<Result> m_results;
+  static inline volatile double s_sink = 0;
+
+  static double Time (const std::function<void()>& f, size_t calls)
+  {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < calls; i++)
+      f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+  }
+
+public:
+  Bench (Options opts) : m_opts(opts) { }
+
+  const Options& Opts() const { return m_opts; }
+
+  // stores a result, such that the computation of it cannot be optimized away
+  static void DoNotOptimize (double val) { s_sink = val; }
+  const std::vector<Result>& Results() const { return m_results; }
+
+  void Run (const std::string& name, size_t n, double flops, double bytes,
+            const std::function<void()>& f)
+  {
+    if (!m_opts.filter.empty() && name.find(m_opts.filter) == std::string::npos)
+      return;
+
+    // warm-up, and calls per sample such that a sample takes 1 ms
+    double t1 = std::max(Time(f, 1), 1e-9);
+    size_t batch = std::max<size_t>(1, size_t(1e-3 / t1));
+
+    std::vector<double> samples;
+    double total = 0;
+    while (samples.size() < m_opts.reps || total < m_opts.mintime)
+      {
+        double t = Time(f, batch);
+        samples.push_back(t / batch);
+        total += t;
+        if (samples.size() >= 1000) break;
+      }
+
+    std::sort(samples.begin(), samples.end());
+    size_t cnt = samples.size();
+    double mean = std::accumulate(samples.begin(), samples.end(), 0.0) / cnt;
+    double var = 0;
+    for (double t : samples)
+      var += (t-mean)*(t-mean);
+
+    Result res { name, n, cnt, samples[0],
+                 (cnt % 2) ? samples[cnt/2] : 0.5*(samples[cnt/2-1]+samples[cnt/2]),
+                 mean, (cnt > 1) ? std::sqrt(var/(cnt-1)) : 0.0, flops, bytes };
+    m_results.push_back(res);
+
+    std::cout << std::left << std::setw(16) << name << std::right
+              << std::setw(9) << n << std::setw(8) << cnt
+              << std::setw(13) << std::setprecision(4) << res.tmedian
+              << std::setw(11) << std::setprecision(3) << 100*res.tstddev/res.tmean
+              << std::setw(11) << res.GFlops() << std::setw(11) << res.GBytes() << std::endl;
+  }
+
+  void WriteJSON (std::ostream& ost) const
+  {
+    ost << "{\n"
+        << "  \"threads\": " << GetNumThreads() << ",\n"
+        << "  \"isa\": \"" << ISAName(GetISA()) << "\",\n"
+        << "  \"simd_bytes\": " << Kernels<double>().simd_bytes << ",\n"
+        << "  \"results\": [\n";
+    ost << std::setprecision(9);
+    for (size_t i = 0; i < m_results.size(); i++)
+      {
+        auto & r = m_results[i];
+        ost << "    { \"name\": \"" << r.name << "\", \"n\": " << r.n
+            << ", \"samples\": " << r.samples
+            << ", \"time_min\": " << r.tmin << ", \"time_median\": " << r.tmedian
+            << ", \"time_mean\": " << r.tmean << ", \"time_stddev\": " << r.tstddev
+            << ", \"flops\": " << r.flops << ", \"bytes\": " << r.bytes
+            << ", \"gflops\": " << r.GFlops() << ", \"gbytes\": " << r.GBytes() << " }"
+            << ((i+1 < m_results.size()) ? ",\n" : "\n");
+      }
+    ost << "  ]\n}\n";
+  }
+};
+
+
+// well conditioned, symmetric positive definite test matrix
+void SetMatrix (MatrixView<double> a)
+{
+  for (size_t i = 0; i < a.rows(); i++)
+    for (size_t j = 0; j < a.cols(); j++)
+      a(i,j) = 1.0 / (1+i+j) + ((i==j) ? double(a.rows()) : 0.0);
+}
+
+
+void BenchVector (Bench& bench)
+{
+  std::vector<size_t> sizes { 1000, 100000, 10000000 };
+  if (bench.Opts().quick) sizes = { 1000, 100000 };
+
+  for (size_t n : sizes)
+    {
+      Vector<double> x(n), a(n), b(n);
+      for (size_t i = 0; i < n; i++)
+        {
+          a(i) = 1.0 / (1+i);
+          b(i) = double(i % 7);
+        }
+
+      bench.Run ("vec_assign", n, 2.0*n, 3.0*n*sizeof(double), [&] { x = a + 3*b; });
+      bench.Run ("dot", n, 2.0*n, 2.0*n*sizeof(double), [&] { Bench::DoNotOptimize (dot(a, b)); });
+      bench.Run ("norm", n, 2.0*n, 1.0*n*sizeof(double), [&] { Bench::DoNotOptimize (norm(a)); });
+      bench.Run ("axpy_lapack", n, 2.0*n, 3.0*n*sizeof(double), [&] { AddVectorLapack (1e-3, a, x); });
+    }
+}
+
+
+void BenchMatrix (Bench& bench)
+{
+  std::vector<size_t> sizes { 50, 200, 1000 };
+  if (bench.Opts().quick) sizes = { 50, 200 };
+
+  for (size_t n : sizes)
+    {
+      Matrix<double> a(n,n), b(n,n);
+      Matrix<double,ColMajor> c(n,n);
+      SetMatrix (a);
+      SetMatrix (b);
+      double mat = n*n*sizeof(double);
+
+      bench.Run ("gemm_expr", n, 2.0*n*n*n, 3*mat, [&] { c = a*b; });
+      bench.Run ("gemm_lapack", n, 2.0*n*n*n, 3*mat, [&] { MultMatMatLapack (a, b, c); });
+
+      Vector<double> x(n), y(n);
+      x = 1.0;
+      bench.Run ("gemv_expr", n, 2.0*n*n, mat + 2.0*n*sizeof(double), [&] { y = a*x; });
+      bench.Run ("gemv_lapack", n, 2.0*n*n, mat + 2.0*n*sizeof(double),
+                 [&] { MultMatVecLapack<double> (1.0, a, x, 0.0, y); });
+
+      // the inverse and the factorizations work on a copy of a, which is included in the times
+      Matrix<double> inv(n,n);
+      bench.Run ("inverse", n, 2.0*n*n*n, 2*mat, [&] { inv = a; calcInverse (inv); });
+      bench.Run ("inverse_lapack", n, 2.0*n*n*n, 2*mat,
+                 [&] { inv = LapackLU<RowMajor>(a).inverse(); });
+
+      // factorizations of the symmetric positive definite test matrix
+      bench.Run ("lu", n, 2.0/3*n*n*n, 2*mat, [&] { LU<double> lu(a); });
+      bench.Run ("cholesky", n, 1.0/3*n*n*n, 2*mat, [&] { Cholesky<double> chol(a); });
+      bench.Run ("cholesky_lapack", n, 1.0/3*n*n*n, 2*mat, [&] { LapackCholesky<RowMajor> chol(a); });
+    }
+}
+
+
+int main (int argc, char ** argv)
+{
+  Options opts;
+  for (int i = 1; i < argc; i++)
+    {
+      std::string arg = argv[i];
+      if (arg == "--quick") opts.quick = true;
+      else if (arg == "--filter" && i+1 < argc) opts.filter = argv[++i];
+      else if (arg == "--json" && i+1 < argc) opts.json = argv[++i];
+      else if (arg == "--reps" && i+1 < argc) opts.reps = std::stoul(argv[++i]);
+      else if (arg == "--mintime" && i+1 < argc) opts.mintime = std::stod(argv[++i]);
+      else
+        {
+          std::cerr << "usage: nanoblas_bench [--quick] [--filter name] [--json file]"
+                    << " [--reps n] [--mintime seconds]" << std::endl;
+          return 1;
+        }
+    }
+
+  Bench bench(opts);
+  std::cout << "threads = " << GetNumThreads() << ", ISA = " << ISAName(GetISA())
+            << ", SIMD bytes = " << Kernels<double>().simd_bytes << std::endl;
+  std::cout << std::left << std::setw(16) << "kernel" << std::right
+            << std::setw(9) << "n" << std::setw(8) << "samples"
+            << std::setw(13) << "time[s]" << std::setw(11) << "stddev[%]"
+            << std::setw(11) << "GFlop/s" << std::setw(11) << "GB/s" << std::endl;
+
+  BenchVector (bench);
+  BenchMatrix (bench);
+
+  if (!opts.json.empty())
+    {
+      std::ofstream out(opts.json);
+      bench.WriteJSON (out);
+      if (!out)
+        {
+          std::cerr << "cannot write " << opts.json << std::endl;
+          return 1;
+        }
+    }
+}
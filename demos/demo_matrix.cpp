@@ -2,6 +2,8 @@
 
 #include <matrix.hpp>
 #include <inverse.hpp>
+#include <lu.hpp>
+#include <cholesky.hpp>
 #include <lapack_interface.hpp>
 
 using namespace nanoblas;
@@ -26,6 +28,10 @@ int main()
   std::cout << "B = \n" << B << std::endl;
   std::cout << "C = A * B = \n" << C << std::endl;
 
+  // native blocked product
+  C = A * B;
+  std::cout << "C = A * B (native) = \n" << C << std::endl;
+
 
   int n = 3;
   Matrix<double> a(n,n);
@@ -41,5 +47,11 @@ int main()
   Matrix<double> inv = a;
   calcInverse (inv);
   std::cout << "calcInverse(a) = " << inv << std::endl; 
+
+  std::cout << "native LU(a).inverse() = " << LU(a).inverse() << std::endl;
+
+  // a is symmetric positive definite
+  std::cout << "Cholesky(a).inverse() = " << Cholesky(a).inverse() << std::endl;
+  std::cout << "LapackCholesky(a).inverse() = " << LapackCholesky(a).inverse() << std::endl;
   
 }
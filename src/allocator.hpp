@@ -0,0 +1,89 @@
+#ifndef FILE_ALLOCATOR
+#define FILE_ALLOCATOR
+
+#include <cstddef>
+#include <new>
+#include <memory>
+#include <algorithm>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace nanoblas
+{
+
+  /*
+    Allocation policies for the owning containers Vector and Matrix
+
+    A policy provides
+      static T* Allocate (size_t n)
+      static void Deallocate (T* p, size_t n)
+      static size_t LeadingDim (size_t len)   distance of rows (RowMajor) or
+                                              columns (ColMajor) of length len
+
+    AlignedAllocator<T, ALIGN, PAD, HUGEPAGES>:
+      ALIGN       alignment of the buffer in bytes
+      PAD         rows/columns start at ALIGN boundaries, and the leading
+                  dimension avoids multiples of 4k (cache/4k aliasing)
+      HUGEPAGES   buffers of at least 2MB are 2MB aligned and backed by
+                  transparent huge pages (madvise, Linux only)
+  */
+
+  template <typename T, size_t ALIGN = 64, bool PAD = false, bool HUGEPAGES = false>
+  struct AlignedAllocator
+  {
+    static constexpr size_t HUGEPAGE_SIZE = size_t(2) << 20;
+
+    static size_t Alignment (size_t bytes)
+    {
+      if (HUGEPAGES && bytes >= HUGEPAGE_SIZE)
+        return HUGEPAGE_SIZE;
+      return std::max(ALIGN, alignof(T));
+    }
+
+    static T* Allocate (size_t n)
+    {
+      if (n == 0) return nullptr;
+      size_t bytes = n*sizeof(T);
+      void* p = ::operator new(bytes, std::align_val_t(Alignment(bytes)));
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+      if (HUGEPAGES && bytes >= HUGEPAGE_SIZE)
+        madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+      T* data = static_cast<T*>(p);
+      std::uninitialized_default_construct_n(data, n);
+      return data;
+    }
+
+    static void Deallocate (T* p, size_t n)
+    {
+      if (!p) return;
+      std::destroy_n(p, n);
+      ::operator delete(p, std::align_val_t(Alignment(n*sizeof(T))));
+    }
+
+    static size_t LeadingDim (size_t len)
+    {
+      if constexpr (!PAD)
+        return len;
+      else
+        {
+          constexpr size_t line = (ALIGN % sizeof(T) == 0) ? ALIGN/sizeof(T) : 1;
+          size_t ld = (len + line-1) / line * line;
+          if (ld > line && (ld*sizeof(T)) % 4096 == 0)
+            ld += line;
+          return ld;
+        }
+    }
+  };
+
+  template <typename T>
+  using PaddedAllocator = AlignedAllocator<T, 64, true>;
+
+  template <typename T>
+  using HugePageAllocator = AlignedAllocator<T, 64, true, true>;
+
+}
+
+#endif
@@ -0,0 +1,341 @@
+#ifndef FILE_BATCHED
+#define FILE_BATCHED
+
+#include <vector>
+#include <stdexcept>
+#include <cmath>
+#include <atomic>
+
+#include "matrix.hpp"
+
+namespace nanoblas
+{
+
+  /*
+    Batches of small matrices of equal size
+
+    The matrices are stored interleaved: groups of W = SimdWidth<T>()
+    matrices, within a group the entries (i,j) of all W matrices are
+    contiguous. The kernels process one group at a time with one matrix
+    per SIMD lane, so the speed does not depend on the (short) loops
+    over the matrix dimensions.
+
+    The batch is padded to full groups. Padding matrices are identity
+    matrices (zero if not square), they never fail a factorization.
+  */
+
+  template <typename T=double, typename TALLOC=AlignedAllocator<T>>
+  class MatrixBatch
+  {
+  public:
+    static constexpr size_t W = SimdWidth<T>();
+  private:
+    size_t m_count, m_rows, m_cols;
+    T* m_data;
+
+    size_t BufferSize() const { return groups()*m_rows*m_cols*W; }
+
+    void InitPadding()
+    {
+      for (size_t b = m_count; b < groups()*W; b++)
+        for (size_t i = 0; i < m_rows; i++)
+          for (size_t j = 0; j < m_cols; j++)
+            (*this)(b,i,j) = (i == j && m_rows == m_cols) ? T(1) : T(0);
+    }
+
+  public:
+    MatrixBatch (size_t count, size_t rows, size_t cols)
+      : m_count(count), m_rows(rows), m_cols(cols)
+    {
+      m_data = TALLOC::Allocate(BufferSize());
+      *this = T(0);
+    }
+
+    MatrixBatch (const MatrixBatch & b2)
+      : MatrixBatch(b2.m_count, b2.m_rows, b2.m_cols)
+    {
+      std::copy (b2.m_data, b2.m_data+BufferSize(), m_data);
+    }
+
+    MatrixBatch (MatrixBatch && b2)
+      : m_count(b2.m_count), m_rows(b2.m_rows), m_cols(b2.m_cols), m_data(b2.m_data)
+    {
+      b2.m_count = b2.m_rows = b2.m_cols = 0;
+      b2.m_data = nullptr;
+    }
+
+    ~MatrixBatch() { TALLOC::Deallocate(m_data, BufferSize()); }
+
+    MatrixBatch& operator= (const MatrixBatch & b2)
+    {
+      assert(m_count==b2.m_count && m_rows==b2.m_rows && m_cols==b2.m_cols);
+      std::copy (b2.m_data, b2.m_data+BufferSize(), m_data);
+      return *this;
+    }
+
+    MatrixBatch& operator= (MatrixBatch && b2)
+    {
+      std::swap(m_count, b2.m_count);
+      std::swap(m_rows, b2.m_rows);
+      std::swap(m_cols, b2.m_cols);
+      std::swap(m_data, b2.m_data);
+      return *this;
+    }
+
+    // all matrices set to val
+    MatrixBatch& operator= (T val)
+    {
+      std::fill (m_data, m_data+BufferSize(), val);
+      InitPadding();
+      return *this;
+    }
+
+    size_t size() const { return m_count; }
+    size_t rows() const { return m_rows; }
+    size_t cols() const { return m_cols; }
+    size_t groups() const { return (m_count + W-1) / W; }
+
+    // entry (i,j) of matrix b
+    T& operator() (size_t b, size_t i, size_t j)
+    { return m_data[((b/W)*m_rows*m_cols + i*m_cols + j)*W + b%W]; }
+    const T& operator() (size_t b, size_t i, size_t j) const
+    { return m_data[((b/W)*m_rows*m_cols + i*m_cols + j)*W + b%W]; }
+
+    // interleaved storage of the g-th group: entry (i,j) of lane l at [(i*cols+j)*W+l]
+    T* Group (size_t g) { return m_data + g*m_rows*m_cols*W; }
+    const T* Group (size_t g) const { return m_data + g*m_rows*m_cols*W; }
+
+    // copy from and to single matrices
+    template <typename TB>
+    void Set (size_t b, const MatExpr<TB>& m)
+    {
+      assert(m.rows()==m_rows && m.cols()==m_cols);
+      for (size_t i = 0; i < m_rows; i++)
+        for (size_t j = 0; j < m_cols; j++)
+          (*this)(b,i,j) = m(i,j);
+    }
+
+    Matrix<T> Get (size_t b) const
+    {
+      Matrix<T> m(m_rows, m_cols);
+      for (size_t i = 0; i < m_rows; i++)
+        for (size_t j = 0; j < m_cols; j++)
+          m(i,j) = (*this)(b,i,j);
+      return m;
+    }
+  };
+
+
+  // grain for parallel loops over groups, ops = work per group
+  inline size_t BatchGrain (size_t ops) { return std::max<size_t>(1, 16384 / std::max<size_t>(ops,1)); }
+
+
+  // ************************* batched GEMM *******************
+
+  // c[b] = a[b] * b[b] for all matrices of the batch
+  template <typename T, typename TALLOC>
+  void MultBatch (const MatrixBatch<T,TALLOC>& a, const MatrixBatch<T,TALLOC>& b,
+                  MatrixBatch<T,TALLOC>& c)
+  {
+    constexpr size_t W = MatrixBatch<T,TALLOC>::W;
+    using SIMDT = SIMD<T,W>;
+    size_t m = a.rows(), k = a.cols(), n = b.cols();
+    assert(a.size()==b.size() && a.size()==c.size());
+    assert(b.rows()==k && c.rows()==m && c.cols()==n);
+
+    ParallelFor (a.groups(), [&a,&b,&c,m,k,n] (size_t g)
+    {
+      const T* pa = a.Group(g);
+      const T* pb = b.Group(g);
+      T* pc = c.Group(g);
+
+      for (size_t i = 0; i < m; i++)
+        {
+          size_t j = 0;
+          // four columns at once, independent accumulators
+          for ( ; j+4 <= n; j += 4)
+            {
+              SIMDT sum[4];
+              for (size_t jj = 0; jj < 4; jj++)
+                sum[jj] = SIMDT(T(0));
+              for (size_t l = 0; l < k; l++)
+                {
+                  SIMDT ail(pa+(i*k+l)*W);
+                  for (size_t jj = 0; jj < 4; jj++)
+                    sum[jj] = FMA(ail, SIMDT(pb+(l*n+j+jj)*W), sum[jj]);
+                }
+              for (size_t jj = 0; jj < 4; jj++)
+                sum[jj].Store(pc+(i*n+j+jj)*W);
+            }
+          for ( ; j < n; j++)
+            {
+              SIMDT sum(T(0));
+              for (size_t l = 0; l < k; l++)
+                sum = FMA(SIMDT(pa+(i*k+l)*W), SIMDT(pb+(l*n+j)*W), sum);
+              sum.Store(pc+(i*n+j)*W);
+            }
+        }
+    }, BatchGrain(m*n*k*W));
+  }
+
+
+  // ************************* batched LU *******************
+
+  /*
+    LU factorization with partial pivoting of all matrices of the
+    batch, same conventions as class LU. The pivot search and row
+    exchanges are done per lane, the elimination for all lanes at once.
+  */
+
+  template <typename T=double, typename TALLOC=AlignedAllocator<T>>
+  class LUBatch
+  {
+    static constexpr size_t W = MatrixBatch<T,TALLOC>::W;
+    using SIMDT = SIMD<T,W>;
+
+    MatrixBatch<T,TALLOC> a;
+    std::vector<size_t> ipiv;   // interleaved like the matrices: [(g*n+j)*W+l]
+
+  public:
+    LUBatch (MatrixBatch<T,TALLOC> _a)
+      : a(std::move(_a)), ipiv(a.groups()*a.rows()*W)
+    {
+      if (a.rows() != a.cols())
+        throw std::invalid_argument("LU: Matrix must be square");
+
+      size_t n = a.rows();
+      size_t count = a.size();
+      // tasks must not throw, report after the loop
+      std::atomic<bool> singular{false};
+      ParallelFor (a.groups(), [this,n,count,&singular] (size_t g)
+      {
+        T* pa = a.Group(g);
+        size_t* piv = ipiv.data() + g*n*W;
+
+        for (size_t j = 0; j < n; j++)
+          {
+            alignas(64) T inv[W];
+            for (size_t l = 0; l < W; l++)
+              {
+                // pivot search
+                size_t p = j;
+                auto maxval = std::abs(pa[(j*n+j)*W+l]);
+                for (size_t i = j+1; i < n; i++)
+                  if (std::abs(pa[(i*n+j)*W+l]) > maxval)
+                    {
+                      p = i;
+                      maxval = std::abs(pa[(i*n+j)*W+l]);
+                    }
+                if (maxval == 0)
+                  {
+                    if (g*W+l < count)
+                      singular = true;
+                    pa[(j*n+j)*W+l] = T(1);
+                  }
+
+                piv[j*W+l] = p;
+                if (p != j)
+                  for (size_t k = 0; k < n; k++)
+                    std::swap (pa[(j*n+k)*W+l], pa[(p*n+k)*W+l]);
+                inv[l] = T(1) / pa[(j*n+j)*W+l];
+              }
+
+            SIMDT vinv(inv);
+            for (size_t i = j+1; i < n; i++)
+              {
+                SIMDT f = SIMDT(pa+(i*n+j)*W) * vinv;
+                f.Store(pa+(i*n+j)*W);
+                for (size_t k = j+1; k < n; k++)
+                  FMA(-f, SIMDT(pa+(j*n+k)*W), SIMDT(pa+(i*n+k)*W)).Store(pa+(i*n+k)*W);
+              }
+          }
+      }, BatchGrain(n*n*n*W));
+
+      if (singular)
+        throw std::runtime_error("LU: Matrix singular");
+    }
+
+    size_t size() const { return a.size(); }
+    size_t rows() const { return a.rows(); }
+
+    // b[i] overwritten with A[i]^{-1} b[i], for all columns of b[i]
+    void solve (MatrixBatch<T,TALLOC>& b) const
+    {
+      size_t n = a.rows(), nrhs = b.cols();
+      if (b.size() != a.size() || b.rows() != n)
+        throw std::invalid_argument("LUBatch::solve: batch sizes don't match");
+
+      ParallelFor (a.groups(), [this,&b,n,nrhs] (size_t g)
+      {
+        const T* pa = a.Group(g);
+        const size_t* piv = ipiv.data() + g*n*W;
+        T* pb = b.Group(g);
+
+        for (size_t j = 0; j < n; j++)
+          for (size_t l = 0; l < W; l++)
+            if (size_t p = piv[j*W+l]; p != j)
+              for (size_t k = 0; k < nrhs; k++)
+                std::swap (pb[(j*nrhs+k)*W+l], pb[(p*nrhs+k)*W+l]);
+
+        // L y = P b, unit diagonal
+        for (size_t i = 0; i < n; i++)
+          for (size_t r = i+1; r < n; r++)
+            {
+              SIMDT f(pa+(r*n+i)*W);
+              for (size_t k = 0; k < nrhs; k++)
+                FMA(-f, SIMDT(pb+(i*nrhs+k)*W), SIMDT(pb+(r*nrhs+k)*W)).Store(pb+(r*nrhs+k)*W);
+            }
+
+        // U x = y
+        for (size_t i = n; i-- > 0; )
+          {
+            alignas(64) T inv[W];
+            for (size_t l = 0; l < W; l++)
+              inv[l] = T(1) / pa[(i*n+i)*W+l];
+            SIMDT vinv(inv);
+            for (size_t k = 0; k < nrhs; k++)
+              (SIMDT(pb+(i*nrhs+k)*W) * vinv).Store(pb+(i*nrhs+k)*W);
+            for (size_t r = 0; r < i; r++)
+              {
+                SIMDT f(pa+(r*n+i)*W);
+                for (size_t k = 0; k < nrhs; k++)
+                  FMA(-f, SIMDT(pb+(i*nrhs+k)*W), SIMDT(pb+(r*nrhs+k)*W)).Store(pb+(r*nrhs+k)*W);
+              }
+          }
+      }, BatchGrain(n*n*nrhs*W));
+    }
+
+    MatrixBatch<T,TALLOC> inverse() const
+    {
+      size_t n = a.rows();
+      MatrixBatch<T,TALLOC> inv(a.size(), n, n);
+      for (size_t b = 0; b < a.size(); b++)
+        for (size_t i = 0; i < n; i++)
+          inv(b,i,i) = T(1);
+      solve (inv);
+      return inv;
+    }
+
+    // factors of all matrices: unit lower triangle L, upper triangle U
+    const MatrixBatch<T,TALLOC>& factors() const { return a; }
+    // row i of matrix b was exchanged with row pivot(b,i)
+    size_t pivot (size_t b, size_t i) const { return ipiv[((b/W)*a.rows()+i)*W + b%W]; }
+  };
+
+
+  // b[i] = A[i]^{-1} b[i]
+  template <typename T, typename TALLOC>
+  void SolveBatch (MatrixBatch<T,TALLOC> a, MatrixBatch<T,TALLOC>& b)
+  {
+    LUBatch<T,TALLOC>(std::move(a)).solve(b);
+  }
+
+  template <typename T, typename TALLOC>
+  MatrixBatch<T,TALLOC> InverseBatch (MatrixBatch<T,TALLOC> a)
+  {
+    return LUBatch<T,TALLOC>(std::move(a)).inverse();
+  }
+
+}
+
+#endif
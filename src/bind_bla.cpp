@@ -1,20 +1,287 @@
 #include <sstream>
+#include <variant>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
+#include <pybind11/numpy.h>
 
 #include "vector.hpp"
+#include "matrix.hpp"
+#include "lu.hpp"
+#include "cholesky.hpp"
 
 using namespace nanoblas;
 namespace py = pybind11;
 
 
+// distance of consecutive entries along axis, in doubles
+static size_t ElementStride (const py::array & arr, int axis)
+{
+  auto stride = arr.strides(axis);
+  if (stride < 0 || stride % sizeof(double) != 0)
+    throw std::invalid_argument("array strides are not compatible with a nanoblas view");
+  return stride / sizeof(double);
+}
+
+static void CheckDouble (const py::array & arr, int ndim)
+{
+  if (!py::isinstance<py::array_t<double>>(arr))
+    throw std::invalid_argument("array must have dtype float64");
+  if (arr.ndim() != ndim)
+    throw std::invalid_argument("array must have "+std::to_string(ndim)+" dimension(s)");
+}
+
+
+// vector arguments of the kernels: a Vector, or a VectorView from asVector
+static bool IsVector (py::handle obj)
+{
+  return py::isinstance<Vector<double>>(obj) || py::isinstance<VectorView<double,size_t>>(obj);
+}
+
+static VectorView<double,size_t> AsVectorView (py::handle obj)
+{
+  if (py::isinstance<Vector<double>>(obj))
+    {
+      auto & v = obj.cast<Vector<double>&>();
+      return VectorView<double,size_t> (v.size(), 1, v.data());
+    }
+  if (py::isinstance<VectorView<double,size_t>>(obj))
+    return obj.cast<VectorView<double,size_t>>();
+  throw py::type_error("expected a Vector or a VectorView");
+}
+
+// matrix arguments: a Matrix, or a view of either ordering from asMatrix
+using AnyMatrixView = std::variant<MatrixView<double,RowMajor>, MatrixView<double,ColMajor>>;
+
+static AnyMatrixView AsMatrixView (py::handle obj)
+{
+  if (py::isinstance<Matrix<double>>(obj))
+    {
+      auto & mat = obj.cast<Matrix<double>&>();
+      return MatrixView<double,RowMajor> (mat.rows(), mat.cols(), mat.dist(), mat.data());
+    }
+  if (py::isinstance<MatrixView<double,RowMajor>>(obj))
+    return obj.cast<MatrixView<double,RowMajor>>();
+  if (py::isinstance<MatrixView<double,ColMajor>>(obj))
+    return obj.cast<MatrixView<double,ColMajor>>();
+  throw py::type_error("expected a Matrix, MatrixView or MatrixViewColMajor");
+}
+
+static size_t Rows (const AnyMatrixView & mat) { return std::visit([](auto & a) { return a.rows(); }, mat); }
+static size_t Cols (const AnyMatrixView & mat) { return std::visit([](auto & a) { return a.cols(); }, mat); }
+
+
+// a @ b, for a matrix a and a matrix or vector b, into a new Matrix or Vector
+static py::object MatMul (py::object a, py::object b)
+{
+  auto va = AsMatrixView(a);
+  if (IsVector(b))
+    {
+      auto x = AsVectorView(b);
+      if (Cols(va) != x.size())
+        throw std::runtime_error("Matrix and vector shapes do not match for product");
+      Vector<double> y(Rows(va));
+      {
+        py::gil_scoped_release release;
+        std::visit([&](auto ma) { y = ma*x; }, va);
+      }
+      return py::cast(std::move(y));
+    }
+
+  auto vb = AsMatrixView(b);
+  if (Cols(va) != Rows(vb))
+    throw std::runtime_error("Matrix shapes do not match for product");
+  Matrix<double> c(Rows(va), Cols(vb));
+  {
+    py::gil_scoped_release release;
+    std::visit([&](auto ma, auto mb) { c = ma*mb; }, va, vb);
+  }
+  return py::cast(std::move(c));
+}
+
+// LU or Cholesky factorization of a copy of the matrix a
+template <typename TFACT>
+TFACT Factor (py::object a)
+{
+  auto va = AsMatrixView(a);
+  py::gil_scoped_release release;
+  Matrix<double> copy(Rows(va), Cols(va));
+  std::visit([&](auto ma) { copy = ma; }, va);
+  return TFACT(std::move(copy));
+}
+
+// b overwritten by A^{-1} b, for a vector b or all columns of a matrix b
+template <typename TFACT>
+void Solve (const TFACT & fact, py::object b)
+{
+  if (IsVector(b))
+    {
+      auto vb = AsVectorView(b);
+      if (vb.size() != fact.size()) throw std::runtime_error("Vector size does not match");
+      py::gil_scoped_release release;
+      fact.solve(vb);
+    }
+  else
+    {
+      auto mb = AsMatrixView(b);
+      if (Rows(mb) != fact.size()) throw std::runtime_error("Matrix rows do not match");
+      py::gil_scoped_release release;
+      std::visit([&](auto mat) { fact.solve(mat); }, mb);
+    }
+}
+
+
+template <ORDERING ORD>
+void BindMatrixView (py::module_ & m, const char * name)
+{
+  using TMAT = MatrixView<double,ORD>;
+  py::class_<TMAT> (m, name, py::buffer_protocol())
+    .def_property_readonly("shape", [](TMAT & self) { return py::make_tuple(self.rows(), self.cols()); })
+    .def("__getitem__", [](TMAT & self, std::tuple<size_t,size_t> ind) {
+      auto [i,j] = ind;
+      if (i >= self.rows() || j >= self.cols()) throw py::index_error("matrix index out of range");
+      return self(i,j);
+    })
+    .def("__setitem__", [](TMAT & self, std::tuple<size_t,size_t> ind, double val) {
+      auto [i,j] = ind;
+      if (i >= self.rows() || j >= self.cols()) throw py::index_error("matrix index out of range");
+      self(i,j) = val;
+    })
+    .def("__matmul__", &MatMul, "product with a matrix or vector, as a new Matrix or Vector")
+    .def("__str__", [](const TMAT & self) {
+      std::stringstream str;
+      str << self;
+      return str.str();
+    })
+    .def_buffer([](TMAT & self) {
+      size_t rowdist = (ORD == RowMajor) ? self.dist() : 1;
+      size_t coldist = (ORD == RowMajor) ? 1 : self.dist();
+      return py::buffer_info(self.data(), sizeof(double), py::format_descriptor<double>::format(), 2,
+                             { self.rows(), self.cols() },
+                             { sizeof(double)*rowdist, sizeof(double)*coldist });
+    });
+}
+
+
 PYBIND11_MODULE(nanoblas_impl, m) {
     m.doc() = "Basic linear algebra module"; // optional module docstring
+
+    // long running functions release the GIL, so other Python threads can work meanwhile
     
-    py::class_<Vector<double>> (m, "Vector")
+    m.def("GetNumThreads", &GetNumThreads, "number of threads used by nanoblas kernels");
+    m.def("SetNumThreads", &SetNumThreads, py::arg("n"),
+          "set number of threads used by nanoblas kernels (0 = default), "
+          "waits until kernels running in other threads are done",
+          py::call_guard<py::gil_scoped_release>());
+
+    m.def("GetISA", [] () { return std::string(ISAName(GetISA())); },
+          "instruction set of the SIMD kernels in use (sse2, avx2, avx512)");
+
+    // products of double matrices go to BLAS if built with NANOBLAS_USE_BLAS, the
+    // native kernel and its parameters then only get operands BLAS cannot take
+#ifdef NANOBLAS_USE_BLAS
+    m.attr("gemm_backend") = "blas";
+#else
+    m.attr("gemm_backend") = "native";
+#endif
+
+    // GEMM parameters of this host, loaded from its profile at the first product
+    auto gemmparams = [] (const GemmParams & par) {
+      py::dict d;
+      auto & tile = Kernels<double>().gemm[par.tile];
+      d["mr"] = tile.mr;
+      d["nr"] = tile.nr;
+      d["mc"] = par.mc;
+      d["kc"] = par.kc;
+      d["nc"] = par.nc;
+      return d;
+    };
+    m.def("GetGemmParameters", [gemmparams] () { return gemmparams (GemmParameters<double>()); },
+          "micro-tile and cache blocking of the native double precision matrix product, "
+          "not used by products evaluated by BLAS (gemm_backend == 'blas')");
+    m.def("TuneGemm", [gemmparams] (bool quick, bool save) {
+      GemmTuneResult res;
+      {
+        py::gil_scoped_release release;
+        res = TuneGemm<double> (quick);
+      }
+      SetGemmParameters<double> (res.par);
+      if (save && !SaveGemmParams<double> (res.par))
+        throw std::runtime_error("cannot write tuning profile " + GemmProfilePath());
+      py::dict d = gemmparams (res.par);
+      d["GFlops"] = res.gflops;
+      return d;
+    }, py::arg("quick") = false, py::arg("save") = true,
+       "benchmark parameters of the native GEMM kernel, use the best, and store them in the "
+       "profile of this host; without effect on products evaluated by BLAS (gemm_backend == 'blas')");
+    m.attr("gemm_profile") = GemmProfilePath();
+
+    // kernel instrumentation, counters are only collected if built with NANOBLAS_PROFILE
+    m.attr("profiling_enabled") = ProfilingEnabled();
+    m.def("GetProfile", [] () {
+      py::list table;
+      for (auto & e : GetProfile())
+        {
+          py::dict row;
+          row["name"] = e.name;
+          row["calls"] = e.calls;
+          row["time"] = e.time;
+          row["flops"] = e.flops;
+          row["bytes"] = e.bytes;
+          row["GFlops"] = e.GFlops();
+          row["GBytes"] = e.GBytes();
+          for (size_t p = 0; p < PERF_NUM_EVENTS; p++)
+            if (PerfEventAvailable(p))
+              row[PerfEventName(p)] = e.perf[p];
+          table.append(row);
+        }
+      return table;
+    }, "per kernel: calls, time [s], flops, bytes, GFlop/s and GB/s");
+    m.def("ResetProfile", &ResetProfile, "set all kernel counters to zero");
+    m.def("PrintProfile", [] () {
+      std::stringstream str;
+      PrintProfile (str);
+      return str.str();
+    }, "kernel counters as a table");
+
+    // hardware counters (Linux perf_event), attributed to kernels while counting is on
+    m.def("SetPerfCounting", &SetPerfCounting, py::arg("on"),
+          "count hardware events in all kernels");
+    m.def("PerfEventsAvailable", [] () {
+      py::list events;
+      for (size_t p = 0; p < PERF_NUM_EVENTS; p++)
+        if (PerfEventAvailable(p))
+          events.append(PerfEventName(p));
+      return events;
+    }, "hardware events supported on this machine");
+
+    py::class_<PerfScope> (m, "PerfScope")
+      .def(py::init([] (std::string name) { return std::make_unique<PerfScope>(name, false); }),
+           py::arg("name") = "python", "region with hardware counters, use in a with statement")
+      .def("__enter__", [] (PerfScope & self) -> PerfScope& { self.Start(); return self; },
+           py::return_value_policy::reference)
+      .def("__exit__", [] (PerfScope & self, py::args) { self.Stop(); })
+      .def_property_readonly("counters", [] (PerfScope & self) {
+        py::dict counts;
+        auto & c = self.Counts();
+        counts["time"] = c.time;
+        for (size_t p = 0; p < PERF_NUM_EVENTS; p++)
+          if (PerfEventAvailable(p))
+            counts[PerfEventName(p)] = c.perf[p];
+        return counts;
+      }, "counts of the last run of the scope");
+    
+    py::class_<Vector<double>> (m, "Vector", py::buffer_protocol())
       .def(py::init<size_t>(),
            py::arg("size"), "create vector of given size")
 
+      .def(py::init([](py::array_t<double, py::array::forcecast> arr) {
+        auto a = arr.unchecked<1>();
+        Vector<double> v(a.shape(0));
+        for (size_t i = 0; i < v.size(); i++)
+          v(i) = a(i);
+        return v;
+      }), py::arg("array"), "create vector as a copy of a 1D array")
+
       .def("__len__", &Vector<double>::size,
            "return size of vector")
       
@@ -43,6 +310,33 @@ PYBIND11_MODULE(nanoblas_impl, m) {
 
       .def("__rmul__", [](Vector<double> & self, double scal)
       { return Vector<double> (scal*self); })
+
+      // in-place operators return the same Python object
+      .def("__iadd__", [](Vector<double> & self, py::object other) -> Vector<double>&
+      {
+        auto vother = AsVectorView(other);
+        if (self.size() != vother.size())
+          throw std::runtime_error("Vector sizes do not match");
+        py::gil_scoped_release release;
+        self += vother;
+        return self;
+      }, py::return_value_policy::reference)
+      
+      .def("__isub__", [](Vector<double> & self, py::object other) -> Vector<double>&
+      {
+        auto vother = AsVectorView(other);
+        if (self.size() != vother.size())
+          throw std::runtime_error("Vector sizes do not match");
+        py::gil_scoped_release release;
+        self -= vother;
+        return self;
+      }, py::return_value_policy::reference)
+      
+      .def("__imul__", [](Vector<double> & self, double scal) -> Vector<double>&
+      {
+        self *= scal;
+        return self;
+      }, py::return_value_policy::reference, py::call_guard<py::gil_scoped_release>())
       
       .def("__str__", [](const Vector<double> & self)
       {
@@ -51,6 +345,12 @@ PYBIND11_MODULE(nanoblas_impl, m) {
         return str.str();
       })
 
+      .def_buffer([](Vector<double> & self)
+      {
+        return py::buffer_info(self.data(), sizeof(double), py::format_descriptor<double>::format(), 1,
+                               { self.size() }, { sizeof(double) });
+      })
+
       /*
      .def(py::pickle(
         [](Vector<double> & self) { // __getstate__
@@ -69,4 +369,209 @@ PYBIND11_MODULE(nanoblas_impl, m) {
         }))
       */
     ;
+
+
+    py::class_<VectorView<double,size_t>> (m, "VectorView", py::buffer_protocol())
+      .def("__len__", &VectorView<double,size_t>::size)
+      .def("__getitem__", [](VectorView<double,size_t> & self, size_t i) {
+        if (i >= self.size()) throw py::index_error("vector index out of range");
+        return self(i);
+      })
+      .def("__setitem__", [](VectorView<double,size_t> & self, size_t i, double v) {
+        if (i >= self.size()) throw py::index_error("vector index out of range");
+        self(i) = v;
+      })
+      .def("__str__", [](const VectorView<double,size_t> & self) {
+        std::stringstream str;
+        str << self;
+        return str.str();
+      })
+      .def_buffer([](VectorView<double,size_t> & self) {
+        return py::buffer_info(self.data(), sizeof(double), py::format_descriptor<double>::format(), 1,
+                               { self.size() }, { sizeof(double)*self.dist() });
+      });
+
+    m.def("asVector", [](py::array arr) {
+      CheckDouble (arr, 1);
+      return VectorView<double,size_t> (arr.shape(0), ElementStride(arr,0),
+                                        static_cast<double*>(arr.mutable_data()));
+    }, py::arg("array"), py::keep_alive<0,1>(),
+      "vector view sharing the memory of a 1D float64 array, accepted by the kernels like a Vector");
+
+    
+    py::class_<Matrix<double>> (m, "Matrix", py::buffer_protocol())
+      .def(py::init<size_t,size_t>(),
+           py::arg("rows"), py::arg("cols"), "create matrix of given size")
+
+      .def(py::init([](py::array_t<double, py::array::forcecast> arr) {
+        auto a = arr.unchecked<2>();
+        Matrix<double> mat(a.shape(0), a.shape(1));
+        for (size_t i = 0; i < mat.rows(); i++)
+          for (size_t j = 0; j < mat.cols(); j++)
+            mat(i,j) = a(i,j);
+        return mat;
+      }), py::arg("array"), "create matrix as a copy of a 2D array")
+
+      .def_property_readonly("shape", [](Matrix<double> & self) { return py::make_tuple(self.rows(), self.cols()); })
+      
+      .def("__getitem__", [](Matrix<double> & self, std::tuple<size_t,size_t> ind) {
+        auto [i,j] = ind;
+        if (i >= self.rows() || j >= self.cols()) throw py::index_error("matrix index out of range");
+        return self(i,j);
+      })
+      .def("__setitem__", [](Matrix<double> & self, std::tuple<size_t,size_t> ind, double val) {
+        auto [i,j] = ind;
+        if (i >= self.rows() || j >= self.cols()) throw py::index_error("matrix index out of range");
+        self(i,j) = val;
+      })
+
+      .def("__matmul__", &MatMul, "product with a matrix or vector, as a new Matrix or Vector")
+      
+      .def("__str__", [](const Matrix<double> & self) {
+        std::stringstream str;
+        str << self;
+        return str.str();
+      })
+
+      .def_buffer([](Matrix<double> & self) {
+        return py::buffer_info(self.data(), sizeof(double), py::format_descriptor<double>::format(), 2,
+                               { self.rows(), self.cols() },
+                               { sizeof(double)*self.dist(), sizeof(double) });
+      });
+
+    BindMatrixView<RowMajor> (m, "MatrixView");
+    BindMatrixView<ColMajor> (m, "MatrixViewColMajor");
+
+    // the kernels take Vector and Matrix objects as well as views of numpy arrays (asVector, asMatrix)
+    
+    m.def("MultMatMat", [](py::object a, py::object b, py::object out) {
+      auto va = AsMatrixView(a), vb = AsMatrixView(b), vc = AsMatrixView(out);
+      if (Cols(va) != Rows(vb) || Rows(vc) != Rows(va) || Cols(vc) != Cols(vb))
+        throw std::runtime_error("Matrix shapes do not match for product");
+      py::gil_scoped_release release;
+      std::visit([](auto ma, auto mb, auto mc) { mc = ma*mb; }, va, vb, vc);
+    }, py::arg("a"), py::arg("b"), py::arg("out"),
+      "out = a @ b, without allocating");
+
+    m.def("dot", [](py::object x, py::object y) {
+      auto vx = AsVectorView(x), vy = AsVectorView(y);
+      if (vx.size() != vy.size())
+        throw std::runtime_error("Vector sizes do not match");
+      py::gil_scoped_release release;
+      return dot(vx, vy);
+    }, py::arg("x"), py::arg("y"));
+
+    m.def("axpy", [](double alpha, py::object x, py::object y) {
+      auto vx = AsVectorView(x), vy = AsVectorView(y);
+      if (vx.size() != vy.size())
+        throw std::runtime_error("Vector sizes do not match");
+      py::gil_scoped_release release;
+      vy += alpha*vx;
+    }, py::arg("alpha"), py::arg("x"), py::arg("y"),
+      "y += alpha*x, in place");
+
+    m.def("lincomb", [](std::vector<double> coefs, std::vector<py::object> vecs, py::object out) {
+      if (coefs.size() != vecs.size() || vecs.empty())
+        throw std::runtime_error("need the same, positive number of coefficients and vectors");
+      std::vector<VectorView<double,size_t>> views;
+      for (auto & v : vecs)
+        views.push_back (AsVectorView(v));
+      size_t n = views[0].size();
+      for (auto & v : views)
+        if (v.size() != n)
+          throw std::runtime_error("Vector sizes do not match");
+
+      py::object result = out.is_none() ? py::cast(Vector<double>(n)) : out;
+      auto res = AsVectorView(result);
+      if (res.size() != n)
+        throw std::runtime_error("size of out does not match");
+
+      {
+        py::gil_scoped_release release;
+        
+        // out may appear several times among the inputs: res is scaled by the sum
+        // of its coefficients before the other terms are added. Inputs sharing
+        // only part of the memory of out are copied first.
+        bool inplace = false;
+        double scale = 0;
+        std::vector<double> tcoefs;
+        std::vector<VectorView<double,size_t>> terms;
+        std::vector<Vector<double>> copies;
+        copies.reserve(views.size());
+        for (size_t k = 0; k < views.size(); k++)
+          if (views[k].Range().SameView(res.Range()))
+            {
+              inplace = true;
+              scale += coefs[k];
+            }
+          else
+            {
+              tcoefs.push_back(coefs[k]);
+              if (views[k].Range().Intersects(res.Range()))
+                {
+                  auto & copy = copies.emplace_back(views[k]);
+                  terms.push_back(VectorView<double,size_t>(copy.size(), 1, copy.data()));
+                }
+              else
+                terms.push_back(views[k]);
+            }
+
+        // blocks of res stay in cache while all terms are added
+        constexpr size_t BS = 4096;
+        ParallelForRange ( (n+BS-1)/BS, [&](size_t bfirst, size_t bnext)
+        {
+          for (size_t b = bfirst; b < bnext; b++)
+            {
+              auto resb = res.range(b*BS, std::min(n, (b+1)*BS));
+              auto vb = [&](size_t k) { return terms[k].range(b*BS, std::min(n, (b+1)*BS)); };
+              
+              size_t next = 0;
+              if (inplace)
+                resb *= scale;
+              else
+                {
+                  resb = tcoefs[0] * vb(0);
+                  next = 1;
+                }
+              for ( ; next < terms.size(); next++)
+                resb += tcoefs[next] * vb(next);
+            }
+        }, VEC_PARALLEL_GRAIN / BS);
+      }
+      return result;
+    }, py::arg("coefs"), py::arg("vecs"), py::arg("out") = py::none(),
+      "sum of coefs[k]*vecs[k] in one pass, stored in out (a new vector if None)");
+
+    m.def("inverse", [](py::object a) {
+      auto lu = Factor<LU<double>>(a);
+      py::gil_scoped_release release;
+      return lu.inverse();
+    }, py::arg("a"), "inverse matrix, by LU factorization");
+
+    py::class_<LU<double>> (m, "LU")
+      .def(py::init(&Factor<LU<double>>),
+           py::arg("a"), "LU factorization with partial pivoting")
+      .def("solve", &Solve<LU<double>>, py::arg("b"),
+           "b overwritten by A^{-1} b, for a vector or all columns of a matrix")
+      .def("inverse", &LU<double>::inverse, py::call_guard<py::gil_scoped_release>());
+
+    py::class_<Cholesky<double>> (m, "Cholesky")
+      .def(py::init(&Factor<Cholesky<double>>),
+           py::arg("a"), "Cholesky factorization A = L L^T of a symmetric positive definite matrix")
+      .def("solve", &Solve<Cholesky<double>>, py::arg("b"),
+           "b overwritten by A^{-1} b, for a vector or all columns of a matrix")
+      .def("inverse", &Cholesky<double>::inverse, py::call_guard<py::gil_scoped_release>());
+    
+    m.def("asMatrix", [](py::array arr) -> py::object {
+      CheckDouble (arr, 2);
+      size_t rowdist = ElementStride(arr,0), coldist = ElementStride(arr,1);
+      double * data = static_cast<double*>(arr.mutable_data());
+      if (coldist == 1)
+        return py::cast(MatrixView<double,RowMajor> (arr.shape(0), arr.shape(1), rowdist, data));
+      if (rowdist == 1)
+        return py::cast(MatrixView<double,ColMajor> (arr.shape(0), arr.shape(1), coldist, data));
+      throw std::invalid_argument("array must be contiguous along rows or columns");
+    }, py::arg("array"), py::keep_alive<0,1>(),
+      "matrix view sharing the memory of a 2D float64 array (C or Fortran ordered), "
+      "accepted by the kernels like a Matrix");
 }
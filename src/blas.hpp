@@ -0,0 +1,138 @@
+#ifndef FILE_BLAS
+#define FILE_BLAS
+
+#include <cstddef>
+#include <algorithm>
+
+#include "profiler.hpp"
+
+/*
+  Optional BLAS backend for the kernels behind expression assignments
+  (C = alpha*A*B, C += A*B, y = alpha*A*x + beta*y, y += alpha*x).
+
+  Enabled by defining NANOBLAS_USE_BLAS and linking a BLAS library,
+  otherwise (and for element types other than double) the native
+  kernels are used. The wrappers take strided operands like GemmKernel
+  and return false if BLAS cannot handle the call, the caller then
+  falls back to the native kernel.
+*/
+
+#ifdef NANOBLAS_USE_BLAS
+extern "C"
+{
+  int dgemm_ (char* transa, char* transb, int* m, int* n, int* k,
+              double* alpha, double* a, int* lda, double* b, int* ldb,
+              double* beta, double* c, int* ldc);
+  int dgemv_ (char* trans, int* m, int* n, double* alpha, double* a, int* lda,
+              double* x, int* incx, double* beta, double* y, int* incy);
+  int daxpy_ (int* n, double* alpha, double* x, int* incx, double* y, int* incy);
+}
+#endif
+
+
+namespace nanoblas
+{
+
+  // c += alpha * a * b
+  template <typename T>
+  bool BlasGemm (size_t /* m */, size_t /* n */, size_t /* k */, T /* alpha */,
+                 const T* /* a */, size_t /* rsa */, size_t /* csa */,
+                 const T* /* b */, size_t /* rsb */, size_t /* csb */,
+                 T* /* c */, size_t /* rsc */, size_t /* csc */)
+  { return false; }
+
+  // y += alpha * a * x
+  template <typename T>
+  bool BlasGemv (size_t /* m */, size_t /* n */, T /* alpha */,
+                 const T* /* a */, size_t /* rsa */, size_t /* csa */,
+                 const T* /* x */, size_t /* incx */, T* /* y */, size_t /* incy */)
+  { return false; }
+
+  // y += alpha * x
+  template <typename T>
+  bool BlasAxpy (size_t /* n */, T /* alpha */, const T* /* x */, size_t /* incx */,
+                 T* /* y */, size_t /* incy */)
+  { return false; }
+
+
+#ifdef NANOBLAS_USE_BLAS
+
+  // column-major description (trans, ld) of a rows x cols matrix with strides rs, cs
+  inline bool BlasLayout (size_t rows, size_t cols, size_t rs, size_t cs, char & trans, int & ld)
+  {
+    if (rs == 1 && (cols == 1 || cs >= rows))
+      {
+        trans = 'N';
+        ld = std::max<size_t>({cs, rows, 1});
+        return true;
+      }
+    if (cs == 1 && (rows == 1 || rs >= cols))
+      {
+        trans = 'T';
+        ld = std::max<size_t>({rs, cols, 1});
+        return true;
+      }
+    return false;
+  }
+
+  inline bool BlasGemm (size_t m, size_t n, size_t k, double alpha,
+                        const double* a, size_t rsa, size_t csa,
+                        const double* b, size_t rsb, size_t csb,
+                        double* c, size_t rsc, size_t csc)
+  {
+    if (m == 0 || n == 0 || k == 0) return true;
+
+    char transc;
+    int ldc;
+    if (!BlasLayout (m, n, rsc, csc, transc, ldc)) return false;
+    // BLAS writes column-major C, otherwise compute C^T += alpha B^T A^T
+    if (transc == 'T')
+      return BlasGemm (n, m, k, alpha, b, csb, rsb, a, csa, rsa, c, csc, rsc);
+
+    char transa, transb;
+    int lda, ldb;
+    if (!BlasLayout (m, k, rsa, csa, transa, lda)) return false;
+    if (!BlasLayout (k, n, rsb, csb, transb, ldb)) return false;
+    NANOBLAS_PROFILE_KERNEL("blas_gemm", 2.0*m*n*k, sizeof(double) * (m*k + k*n + 2*m*n));
+
+    int im = m, in = n, ik = k;
+    double beta = 1;
+    dgemm_ (&transa, &transb, &im, &in, &ik, &alpha,
+            const_cast<double*>(a), &lda, const_cast<double*>(b), &ldb,
+            &beta, c, &ldc);
+    return true;
+  }
+
+  inline bool BlasGemv (size_t m, size_t n, double alpha, const double* a, size_t rsa, size_t csa,
+                        const double* x, size_t incx, double* y, size_t incy)
+  {
+    if (m == 0 || n == 0) return true;
+
+    char trans;
+    int lda;
+    if (!BlasLayout (m, n, rsa, csa, trans, lda)) return false;
+    NANOBLAS_PROFILE_KERNEL("blas_gemv", 2.0*m*n, sizeof(double) * (m*n + n + 2*m));
+
+    // dimensions of the stored column-major matrix
+    int im = (trans == 'N') ? m : n;
+    int in = (trans == 'N') ? n : m;
+    int ix = std::max<size_t>(incx,1), iy = std::max<size_t>(incy,1);
+    double beta = 1;
+    dgemv_ (&trans, &im, &in, &alpha, const_cast<double*>(a), &lda,
+            const_cast<double*>(x), &ix, &beta, y, &iy);
+    return true;
+  }
+
+  inline bool BlasAxpy (size_t n, double alpha, const double* x, size_t incx, double* y, size_t incy)
+  {
+    NANOBLAS_PROFILE_KERNEL("blas_axpy", 2.0*n, 3*n*sizeof(double));
+    int in = n, ix = incx, iy = incy;
+    daxpy_ (&in, &alpha, const_cast<double*>(x), &ix, y, &iy);
+    return true;
+  }
+
+#endif
+
+}
+
+#endif
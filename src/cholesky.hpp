@@ -0,0 +1,133 @@
+#ifndef FILE_CHOLESKY
+#define FILE_CHOLESKY
+
+#include <stdexcept>
+#include <cmath>
+
+#include "matrix.hpp"
+#include "triangular.hpp"
+
+namespace nanoblas
+{
+
+  /*
+    Native Cholesky factorization of a symmetric positive definite
+    matrix (potrf):
+
+      A = L L^T
+
+    Only the lower triangle of a is used, and overwritten by L. The
+    strictly upper triangle is not referenced.
+
+    Recursive algorithm: factor the upper left block, solve for the
+    lower left block with the triangular solve (on a transposed copy, the
+    solve is fast along the rows of the storage), update the lower right
+    block by the symmetric rank-k update (GEMM kernel), and factor it.
+    Blocks of at most CHOLESKY_BLOCK rows are factored by substitution.
+    This costs n^3/3 flops, half of LU.
+  */
+
+  constexpr size_t CHOLESKY_BLOCK = 32;
+
+  template <typename T, ORDERING ORD>
+  void CholeskyFactor (MatrixView<T,ORD> a)
+  {
+    size_t n = a.rows();
+
+    if (n <= CHOLESKY_BLOCK)
+      {
+        for (size_t j = 0; j < n; j++)
+          {
+            T d = a(j,j);
+            for (size_t k = 0; k < j; k++)
+              d -= a(j,k) * a(j,k);
+            if (!(d > T(0)))
+              throw std::runtime_error("Cholesky: Matrix not positive definite");
+
+            T ljj = std::sqrt(d);
+            a(j,j) = ljj;
+            T inv = T(1) / ljj;
+            for (size_t i = j+1; i < n; i++)
+              {
+                T sum = a(i,j);
+                for (size_t k = 0; k < j; k++)
+                  sum -= a(i,k) * a(j,k);
+                a(i,j) = sum * inv;
+              }
+          }
+        return;
+      }
+
+    size_t n1 = n/2;
+    auto a11 = a.rows(0,n1).cols(0,n1);
+    auto a21 = a.rows(n1,n).cols(0,n1);
+    auto a22 = a.rows(n1,n).cols(n1,n);
+
+    CholeskyFactor (a11);
+
+    // L21^T = L11^{-1} A21^T, solved on a transposed copy with rows along the storage
+    Matrix<T,ORD> l21t(n1, n-n1);
+    l21t = trans(a21);
+    TriangularSolve<Lower,NonUnit> (a11, MatrixView<T,ORD>(l21t));
+    a21 = trans(MatrixView<T,ORD>(l21t));
+
+    SymmetricRankUpdate (T(-1), a21, a22);
+    CholeskyFactor (a22);
+  }
+
+
+
+  template <typename T=double, ORDERING ORD=RowMajor>
+  class Cholesky
+  {
+    Matrix<T,ORD> a;
+
+  public:
+    Cholesky (Matrix<T,ORD> _a)
+      : a(std::move(_a))
+    {
+      if (a.rows() != a.cols())
+        throw std::invalid_argument("Cholesky: Matrix must be square");
+      NANOBLAS_PROFILE_KERNEL("cholesky", 1.0/3*a.rows()*a.rows()*a.rows(), 2.0*a.rows()*a.rows()*sizeof(T));
+      CholeskyFactor<T,ORD> (a);
+    }
+
+    size_t size() const { return a.rows(); }
+
+    // b overwritten with A^{-1} b, for all columns of b
+    template <ORDERING OB>
+    void solve (MatrixView<T,OB> b) const
+    {
+      assert(b.rows() == a.rows());
+      NANOBLAS_PROFILE_KERNEL("cholesky_solve", 2.0*a.rows()*a.rows()*b.cols(),
+                              sizeof(T) * (a.rows()*a.rows() + 2*b.rows()*b.cols()));
+      MatrixView<T,ORD> l(a);
+      TriangularSolve<Lower,NonUnit> (l, b);
+      TriangularSolve<Upper,NonUnit> (trans(l), b);
+    }
+
+    // b overwritten with A^{-1} b
+    template <typename TDIST>
+    void solve (VectorView<T,TDIST> b) const
+    {
+      solve (MatrixView<T,RowMajor> (b.size(), 1, b.dist(), b.data()));
+    }
+
+    Matrix<T,ORD> inverse() const
+    {
+      size_t n = a.rows();
+      Matrix<T,ORD> inv(n,n);
+      inv = T(0);
+      for (size_t i = 0; i < n; i++)
+        inv(i,i) = T(1);
+      solve (inv);
+      return inv;
+    }
+
+    // L in the lower triangle, the strictly upper triangle is the one of the input
+    const Matrix<T,ORD>& factor() const { return a; }
+  };
+
+}
+
+#endif
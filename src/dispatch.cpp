@@ -0,0 +1,65 @@
+/*
+  Runtime selection of the kernel tables for the nanoblas_kernels library
+
+  The tables are compiled in kernels_isa.cpp, once per instruction set.
+  The CPU is queried by CPUID (__builtin_cpu_supports also checks that
+  the OS saves the AVX registers), NANOBLAS_ISA = sse2 | avx2 | avx512
+  may select a lower level.
+*/
+
+#include <cstdlib>
+#include <cstring>
+
+#include "kernels.hpp"
+
+#if !(defined(__x86_64__) || defined(__i386__)) || !defined(__GNUC__)
+#error "the nanoblas_kernels library needs x86 and GCC or Clang"
+#endif
+
+namespace nanoblas
+{
+  namespace dispatch_sse2 { template <typename T> const KernelTable<T>& NativeKernels(); }
+  namespace dispatch_avx2 { template <typename T> const KernelTable<T>& NativeKernels(); }
+  namespace dispatch_avx512 { template <typename T> const KernelTable<T>& NativeKernels(); }
+
+  static ISA SelectISA()
+  {
+    __builtin_cpu_init();
+    ISA isa = ISA_SSE2;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+      {
+        isa = ISA_AVX2;
+        if (__builtin_cpu_supports("avx512f"))
+          isa = ISA_AVX512;
+      }
+
+    if (const char* env = std::getenv("NANOBLAS_ISA"))
+      for (ISA lower : { ISA_SSE2, ISA_AVX2 })
+        if (lower < isa && std::strcmp(env, ISAName(lower)) == 0)
+          isa = lower;
+    return isa;
+  }
+
+  template <typename T>
+  static const KernelTable<T>& SelectKernels()
+  {
+    switch (SelectISA())
+      {
+      case ISA_AVX512: return dispatch_avx512::NativeKernels<T>();
+      case ISA_AVX2: return dispatch_avx2::NativeKernels<T>();
+      default: return dispatch_sse2::NativeKernels<T>();
+      }
+  }
+
+  template <> const KernelTable<double>& DispatchedKernels<double>()
+  {
+    static const KernelTable<double>& kernels = SelectKernels<double>();
+    return kernels;
+  }
+
+  template <> const KernelTable<float>& DispatchedKernels<float>()
+  {
+    static const KernelTable<float>& kernels = SelectKernels<float>();
+    return kernels;
+  }
+}
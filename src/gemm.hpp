@@ -0,0 +1,237 @@
+#ifndef FILE_GEMM
+#define FILE_GEMM
+
+#include <cstddef>
+#include <algorithm>
+#include <vector>
+#include <type_traits>
+
+#include "kernels.hpp"
+#include "taskmanager.hpp"
+#include "blas.hpp"
+
+namespace nanoblas
+{
+
+  /*
+    Native matrix-matrix multiplication
+
+    C += alpha * A * B, where matrices are given by a pointer and
+    a row- and a column-distance. This covers RowMajor, ColMajor and
+    transposed views with the same code.
+
+    Blocking follows the Goto/BLIS scheme:
+      - a KC x NC panel of B is packed once and stays in L3
+      - a MC x KC block of A is packed and stays in L2
+      - the MR x NR micro-kernel keeps a tile of C in registers,
+        streaming slivers of packed A and B from L1
+
+    The packed B-panel is shared by all threads, the MC-blocks of rows
+    of C are distributed to the task manager, each task packs its own
+    block of A. Packing and micro-kernels are taken from Kernels<T>()
+    (kernels.hpp), which may be compiled for another instruction set.
+  */
+
+  // cache blocking and the micro-tile, an index into Kernels<T>().gemm
+  struct GemmParams
+  {
+    size_t tile = 0;
+    size_t mc = 128;
+    size_t kc = 256;
+    size_t nc = 4096;
+  };
+
+
+  // ************************* packing *******************
+
+  /*
+    Per-thread packing buffer, reused between calls. While waiting for
+    parallel tasks a thread may pick up a nested product, which then
+    gets a buffer of its own.
+  */
+  template <typename T, int ID>
+  class PackBuffer
+  {
+    struct Storage
+    {
+      std::vector<T> mem;
+      bool busy = false;
+    };
+    Storage* m_storage = nullptr;
+    std::vector<T> m_own;
+    T* m_data;
+  public:
+    PackBuffer (size_t size)
+    {
+      thread_local Storage storage;
+      if (!storage.busy)
+        {
+          m_storage = &storage;
+          m_storage->busy = true;
+          if (m_storage->mem.size() < size) m_storage->mem.resize(size);
+          m_data = m_storage->mem.data();
+        }
+      else
+        {
+          m_own.resize(size);
+          m_data = m_own.data();
+        }
+    }
+    PackBuffer (const PackBuffer&) = delete;
+    ~PackBuffer () { if (m_storage) m_storage->busy = false; }
+    T* Data() const { return m_data; }
+  };
+
+
+  // ************************* blocked driver *******************
+
+  template <typename T>
+  void GemmKernel (size_t m, size_t n, size_t k, T alpha,
+                   const T* a, size_t rsa, size_t csa,
+                   const T* b, size_t rsb, size_t csb,
+                   T* c, size_t rsc, size_t csc,
+                   const GemmParams& par = GemmParams())
+  {
+    if (m == 0 || n == 0 || k == 0) return;
+    const GemmTileKernels<T>& kern = Kernels<T>().gemm[std::min(par.tile, GEMM_TILES-1)];
+    size_t MR = kern.mr, NR = kern.nr;
+    size_t MC = std::max(par.mc, MR), KC = std::max<size_t>(par.kc, 1), NC = std::max(par.nc, NR);
+
+    size_t nthreads = GetNumThreads();
+    size_t flops = m*n*k;
+    if (flops < 64*64*64) nthreads = 1;
+
+    // enough row-blocks to keep all threads busy
+    size_t mcblock = MC;
+    if (nthreads > 1)
+      mcblock = std::clamp<size_t>((m/nthreads + MR-1) / MR * MR, MR, MC);
+    
+    size_t ncmax = (std::min(NC, n) + NR-1) / NR * NR;
+    size_t kcmax = std::min(KC, k);
+    PackBuffer<T,1> bufB(kcmax*ncmax);
+    T* pb = bufB.Data();
+
+    for (size_t jc = 0; jc < n; jc += NC)
+      {
+        size_t nc = std::min(NC, n-jc);
+        for (size_t pc = 0; pc < k; pc += KC)
+          {
+            size_t kc = std::min(KC, k-pc);
+            size_t npanels = (nc + NR-1) / NR;
+            ParallelForRange (npanels, [=, &kern] (size_t first, size_t next)
+            {
+              size_t j0 = first*NR, j1 = std::min(nc, next*NR);
+              kern.pack_b (kc, j1-j0, b + pc*rsb + (jc+j0)*csb, rsb, csb, pb + j0*kc);
+            }, (nthreads > 1) ? 16 : npanels);
+
+            size_t nblocks = (m + mcblock-1) / mcblock;
+            ParallelFor (nblocks, [=, &kern] (size_t blk)
+            {
+              size_t ic = blk * mcblock;
+              size_t mc = std::min(mcblock, m-ic);
+              PackBuffer<T,0> bufA((mc + MR-1) / MR * MR * kc);
+              T* pa = bufA.Data();
+              kern.pack_a (mc, kc, a + ic*rsa + pc*csa, rsa, csa, pa);
+              kern.macro (mc, nc, kc, pa, pb, alpha, c + ic*rsc + jc*csc, rsc, csc);
+            }, (nthreads > 1) ? 1 : nblocks);
+          }
+      }
+  }
+
+
+  // ************************* matrix-vector *******************
+
+  // y += alpha * A * x, A is m x n with row- and column-distance rsa, csa
+  template <typename T>
+  void GemvKernel (size_t m, size_t n, T alpha, const T* a, size_t rsa, size_t csa,
+                   const T* x, size_t incx, T* y, size_t incy)
+  {
+    constexpr size_t W = SimdWidth<T>();
+    using SIMDT = SIMD<T,W>;
+    if (m == 0 || n == 0) return;
+
+    if constexpr (std::is_floating_point_v<T>)
+      {
+        if (csa == 1 && incx == 1)
+          {
+            // contiguous rows: four dot-products sharing the loads of x
+            ParallelForRange (m, [=] (size_t first, size_t next)
+            {
+              size_t i = first;
+              for ( ; i+4 <= next; i += 4)
+                {
+                  const T* ai = a + i*rsa;
+                  SIMDT s0(T(0)), s1(T(0)), s2(T(0)), s3(T(0));
+                  size_t j = 0;
+                  for ( ; j+W <= n; j += W)
+                    {
+                      SIMDT xj(x+j);
+                      s0 = FMA(SIMDT(ai+j), xj, s0);
+                      s1 = FMA(SIMDT(ai+rsa+j), xj, s1);
+                      s2 = FMA(SIMDT(ai+2*rsa+j), xj, s2);
+                      s3 = FMA(SIMDT(ai+3*rsa+j), xj, s3);
+                    }
+                  T sum[4] = { HSum(s0), HSum(s1), HSum(s2), HSum(s3) };
+                  for ( ; j < n; j++)
+                    for (size_t l = 0; l < 4; l++)
+                      sum[l] += ai[l*rsa+j] * x[j];
+                  for (size_t l = 0; l < 4; l++)
+                    y[(i+l)*incy] += alpha * sum[l];
+                }
+              for ( ; i < next; i++)
+                {
+                  T sum = T(0);
+                  for (size_t j = 0; j < n; j++)
+                    sum += a[i*rsa+j] * x[j];
+                  y[i*incy] += alpha * sum;
+                }
+            }, std::max<size_t>(4, 16384/n/4*4));
+            return;
+          }
+
+        if (rsa == 1 && incy == 1)
+          {
+            // contiguous columns: a block of y is updated by four columns at a time
+            ParallelForRange (m, [=] (size_t first, size_t next)
+            {
+              for (size_t j = 0; j < n; j += 4)
+                {
+                  size_t nj = std::min<size_t>(4, n-j);
+                  const T* aj[4];
+                  T xj[4];
+                  for (size_t l = 0; l < 4; l++)
+                    {
+                      aj[l] = a + (j + (l < nj ? l : 0))*csa;
+                      xj[l] = (l < nj) ? alpha * x[(j+l)*incx] : T(0);
+                    }
+                  SIMDT x0(xj[0]), x1(xj[1]), x2(xj[2]), x3(xj[3]);
+                  size_t i = first;
+                  for ( ; i+W <= next; i += W)
+                    {
+                      SIMDT yi(y+i);
+                      yi = FMA(x0, SIMDT(aj[0]+i), yi);
+                      yi = FMA(x1, SIMDT(aj[1]+i), yi);
+                      yi = FMA(x2, SIMDT(aj[2]+i), yi);
+                      yi = FMA(x3, SIMDT(aj[3]+i), yi);
+                      yi.Store(y+i);
+                    }
+                  for ( ; i < next; i++)
+                    y[i] += xj[0]*aj[0][i] + xj[1]*aj[1][i] + xj[2]*aj[2][i] + xj[3]*aj[3][i];
+                }
+            }, std::max<size_t>(64, 16384/n/W*W));
+            return;
+          }
+      }
+
+    ParallelFor (m, [=] (size_t i)
+    {
+      T sum = T(0);
+      for (size_t j = 0; j < n; j++)
+        sum += a[i*rsa+j*csa] * x[j*incx];
+      y[i*incy] += alpha * sum;
+    }, std::max<size_t>(1, 16384/n));
+  }
+
+}
+
+#endif
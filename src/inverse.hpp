@@ -1,10 +1,13 @@
 #ifndef INVERSE_HPP
 #define INVERSE_HPP
 
+#include <array>
+#include <cmath>
 #include <vector>
 #include <utility>
 
 #include <matrix.hpp>
+#include <taskmanager.hpp>
 
 namespace nanoblas {
 
@@ -15,6 +18,7 @@ namespace nanoblas {
       throw std::invalid_argument("Matrix must be square to compute its inverse.");
 
     size_t n = mat.rows();
+    NANOBLAS_PROFILE_KERNEL("inverse", 2.0*n*n*n, 2*n*n*sizeof(T));
 
     std::vector<int> p(n);   // pivot-permutation
     for (size_t j = 0; j < n; j++) p[j] = j;
@@ -29,7 +33,7 @@ namespace nanoblas {
 	  if (abs (mat(j, i)) > maxval)
 	    {
 	      r = i;
-	      maxval = abs (mat(r, i));
+	      maxval = abs (mat(j, i));
 	    }
       
         double rest = 0.0;
@@ -55,17 +59,18 @@ namespace nanoblas {
           mat(j,i) *= hr;
 	mat(j,j) = hr;
 
-	for (size_t k = 0; k < n; k++)
-	  if (k != j)
-	    {
-	      T help = mat(k,j);
-	      T h = help * hr;   
+	// rows are updated independently
+	ParallelFor (n, [&mat,j,n,hr] (size_t k)
+	  {
+	    if (k == j) return;
+	    T help = mat(k,j);
+	    T h = help * hr;   
 
-	      for (size_t i = 0; i < n; i++)
-                mat(k,i) -= help * mat(j,i); 
+	    for (size_t i = 0; i < n; i++)
+              mat(k,i) -= help * mat(j,i); 
 
-	      mat(k,j) = -h;
-	    }
+	    mat(k,j) = -h;
+	  }, std::max<size_t>(1, 16384/n));
       }
 
     // row exchange
@@ -79,6 +84,78 @@ namespace nanoblas {
   }
 
 
+  // inverse of a fixed size matrix, explicit formulas up to 3x3,
+  // elimination without heap allocation beyond
+  template <size_t N, typename T>
+  Mat<N,N,T> inverse (const Mat<N,N,T>& a)
+  {
+    Mat<N,N,T> inv;
+    if constexpr (N <= 3)
+      {
+        T d = det(a);
+        if (d == T(0))
+          throw std::runtime_error("Inverse matrix: Matrix singular");
+        T id = T(1) / d;
+        if constexpr (N == 1)
+          inv(0,0) = id;
+        else if constexpr (N == 2)
+          {
+            inv(0,0) =  id*a(1,1); inv(0,1) = -id*a(0,1);
+            inv(1,0) = -id*a(1,0); inv(1,1) =  id*a(0,0);
+          }
+        else
+          {
+            // transposed cofactors
+            Unroll<3> ([&] (auto i)
+            {
+              Unroll<3> ([&] (auto j)
+              {
+                constexpr size_t r1 = (j.value+1)%3, r2 = (j.value+2)%3;
+                constexpr size_t c1 = (i.value+1)%3, c2 = (i.value+2)%3;
+                inv(i,j) = id * (a(r1,c1)*a(r2,c2) - a(r1,c2)*a(r2,c1));
+              });
+            });
+          }
+      }
+    else
+      {
+        // Gauss-Jordan in place with row pivoting, pivots and the pivot row on the stack
+        inv = a;
+        std::array<size_t,N> piv;
+        std::array<T,N> row;
+        for (size_t j = 0; j < N; j++)
+          {
+            size_t r = j;
+            for (size_t i = j+1; i < N; i++)
+              if (std::abs(inv(i,j)) > std::abs(inv(r,j)))
+                r = i;
+            if (inv(r,j) == T(0))
+              throw std::runtime_error("Inverse matrix: Matrix singular");
+            piv[j] = r;
+            if (r != j)
+              Unroll<N> ([&] (auto i) { std::swap (inv(j,i), inv(r,i)); });
+
+            T hr = T(1) / inv(j,j);
+            Unroll<N> ([&] (auto i) { row[i] = (i == j) ? hr : hr * inv(j,i); });
+            Unroll<N> ([&] (auto i) { inv(j,i) = row[i]; });
+
+            for (size_t k = 0; k < N; k++)
+              if (k != j)
+                {
+                  T help = inv(k,j);
+                  inv(k,j) = T(0);
+                  Unroll<N> ([&] (auto i) { inv(k,i) -= help * row[i]; });
+                }
+          }
+
+        // row exchanges of a are column exchanges of the inverse
+        for (size_t j = N; j-- > 0; )
+          if (piv[j] != j)
+            Unroll<N> ([&] (auto i) { std::swap (inv(i,j), inv(i,piv[j])); });
+      }
+    return inv;
+  }
+
 }
 
 #endif
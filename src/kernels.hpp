@@ -0,0 +1,411 @@
+#ifndef FILE_KERNELS
+#define FILE_KERNELS
+
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+
+#include "simd.hpp"
+
+namespace nanoblas
+{
+
+  /*
+    SIMD kernels, selected at runtime
+
+    The inner kernels of GEMM, dot, axpy, the transpose and the LU panel
+    work on raw pointers and start no tasks. The drivers (GemmKernel,
+    dot, AxpyKernel, TransposeKernel, LUFactor) split the work and call
+    them through a table of function pointers:
+
+      Kernels<T>()         the table in use
+      NativeKernels<T>()   kernels compiled with the flags of this translation unit
+      GetISA()             instruction set of Kernels<double>()
+
+    Header-only, Kernels<T>() are the native kernels. With
+    NANOBLAS_DISPATCH the library nanoblas_kernels provides the kernels
+    for float and double compiled for SSE2, AVX2+FMA and AVX-512, and
+    picks the best one supported by the CPU at the first call. The
+    environment variable NANOBLAS_ISA = sse2 | avx2 | avx512 limits the
+    choice, e.g. for testing.
+  */
+
+  enum ISA { ISA_GENERIC, ISA_SSE2, ISA_AVX2, ISA_AVX512 };
+
+  inline const char* ISAName (ISA isa)
+  {
+    static const char* names[] = { "generic", "sse2", "avx2", "avx512" };
+    return names[isa];
+  }
+
+  // GEMM on packed blocks, micro-tiles of mr x nr
+  template <typename T>
+  struct GemmTileKernels
+  {
+    size_t mr, nr;
+    void (*pack_a) (size_t mc, size_t kc, const T* a, size_t rsa, size_t csa, T* pa);
+    void (*pack_b) (size_t kc, size_t nc, const T* b, size_t rsb, size_t csb, T* pb);
+    void (*macro) (size_t mc, size_t nc, size_t kc, const T* pa, const T* pb,
+                   T alpha, T* c, size_t rsc, size_t csc);
+  };
+
+  constexpr size_t GEMM_TILES = 3;
+
+  template <typename T>
+  struct KernelTable
+  {
+    ISA isa;
+    size_t simd_bytes;
+
+    // candidate micro-tiles for tuning (tuning.hpp), gemm[0] is the default
+    GemmTileKernels<T> gemm[GEMM_TILES];
+
+    // contiguous vectors
+    T (*dot) (size_t n, const T* x, const T* y);
+    void (*axpy) (size_t n, T alpha, const T* x, T* y);
+
+    // b = alpha * a^T, a is m x n by rows
+    void (*transpose) (size_t m, size_t n, T alpha, const T* a, size_t lda, T* b, size_t ldb);
+
+    // unblocked LU of a m x n panel, false if singular
+    bool (*lu_panel) (size_t m, size_t n, T* a, size_t rs, size_t cs, size_t* ipiv);
+  };
+
+  constexpr size_t TRANSPOSE_TILE = 32;
+
+
+inline namespace NANOBLAS_ISA
+{
+
+  constexpr ISA CompiledISA()
+  {
+#if defined(__AVX512F__)
+    return ISA_AVX512;
+#elif defined(__AVX2__)
+    return ISA_AVX2;
+#elif defined(__SSE2__)
+    return ISA_SSE2;
+#else
+    return ISA_GENERIC;
+#endif
+  }
+
+
+  // ************************* vector kernels *******************
+
+  // sum of x[i]*y[i], four independent accumulators hide the FMA latency
+  template <typename T>
+  T DotRange (size_t n, const T* x, const T* y)
+  {
+    size_t i = 0;
+    T sum = T(0);
+    if constexpr (std::is_floating_point_v<T>)
+      {
+        constexpr size_t W = SimdWidth<T>();
+        using SIMDT = SIMD<T,W>;
+        SIMDT s0(T(0)), s1(T(0)), s2(T(0)), s3(T(0));
+        for ( ; i+4*W <= n; i += 4*W)
+          {
+            s0 = FMA(SIMDT(x+i), SIMDT(y+i), s0);
+            s1 = FMA(SIMDT(x+i+W), SIMDT(y+i+W), s1);
+            s2 = FMA(SIMDT(x+i+2*W), SIMDT(y+i+2*W), s2);
+            s3 = FMA(SIMDT(x+i+3*W), SIMDT(y+i+3*W), s3);
+          }
+        for ( ; i+W <= n; i += W)
+          s0 = FMA(SIMDT(x+i), SIMDT(y+i), s0);
+        sum = HSum((s0+s1)+(s2+s3));
+      }
+    for ( ; i < n; i++)
+      sum += x[i]*y[i];
+    return sum;
+  }
+
+  // y[i] += alpha * x[i]
+  template <typename T>
+  void AxpyRange (size_t n, T alpha, const T* x, T* y)
+  {
+    size_t i = 0;
+    if constexpr (std::is_floating_point_v<T>)
+      {
+        constexpr size_t W = SimdWidth<T>();
+        using SIMDT = SIMD<T,W>;
+        SIMDT valpha(alpha);
+        for ( ; i+2*W <= n; i += 2*W)
+          {
+            FMA(valpha, SIMDT(x+i), SIMDT(y+i)).Store(y+i);
+            FMA(valpha, SIMDT(x+i+W), SIMDT(y+i+W)).Store(y+i+W);
+          }
+        for ( ; i+W <= n; i += W)
+          FMA(valpha, SIMDT(x+i), SIMDT(y+i)).Store(y+i);
+      }
+    for ( ; i < n; i++)
+      y[i] += alpha * x[i];
+  }
+
+
+  // ************************* GEMM kernels *******************
+
+  /*
+    Micro-tile candidates, MR rows x NR/W SIMD registers of accumulators.
+    The default uses half of the register file, the others are larger
+    tiles with fewer loads per FMA, which may spill on some cores.
+  */
+  template <typename T>
+  struct GemmMicroTiles
+  {
+    static constexpr size_t W = SimdWidth<T>();
+    static constexpr size_t MR[GEMM_TILES] =
+      { (SIMD_BYTES == 64) ? 8 : 4, (SIMD_BYTES == 64) ? 12 : 6, (SIMD_BYTES == 64) ? 6 : 4 };
+    static constexpr size_t NR[GEMM_TILES] = { 2*W, 2*W, 3*W };
+  };
+
+  // A-block is stored as row-panels of height MR, within a panel column by column
+  template <typename T, size_t MR>
+  void PackA (size_t mc, size_t kc, const T* a, size_t rsa, size_t csa, T* pa)
+  {
+    for (size_t i0 = 0; i0 < mc; i0 += MR)
+      {
+        size_t mr = Min(MR, mc-i0);
+        const T* ai = a + i0*rsa;
+        for (size_t k = 0; k < kc; k++, pa += MR)
+          {
+            for (size_t i = 0; i < mr; i++)
+              pa[i] = ai[i*rsa + k*csa];
+            for (size_t i = mr; i < MR; i++)
+              pa[i] = T(0);
+          }
+      }
+  }
+
+  // B-panel is stored as column-panels of width NR, within a panel row by row
+  template <typename T, size_t NR>
+  void PackB (size_t kc, size_t nc, const T* b, size_t rsb, size_t csb, T* pb)
+  {
+    for (size_t j0 = 0; j0 < nc; j0 += NR)
+      {
+        size_t nr = Min(NR, nc-j0);
+        const T* bj = b + j0*csb;
+        for (size_t k = 0; k < kc; k++, pb += NR)
+          {
+            for (size_t j = 0; j < nr; j++)
+              pb[j] = bj[k*rsb + j*csb];
+            for (size_t j = nr; j < NR; j++)
+              pb[j] = T(0);
+          }
+      }
+  }
+
+  // c(0:mr, 0:nr) += alpha * pa * pb, packed operands are zero-padded to MR x NR
+  template <typename T, size_t MR, size_t NR>
+  void MicroKernel (size_t kc, const T* pa, const T* pb, T alpha,
+                    T* c, size_t rsc, size_t csc, size_t mr, size_t nr)
+  {
+    constexpr size_t W = SimdWidth<T>();
+    constexpr size_t NV = NR / W;
+    static_assert (NR % W == 0, "NR must be a multiple of the SIMD width");
+
+    SIMD<T,W> acc[MR][NV];
+    for (size_t i = 0; i < MR; i++)
+      for (size_t j = 0; j < NV; j++)
+        acc[i][j] = SIMD<T,W>(T(0));
+
+    for (size_t k = 0; k < kc; k++, pa += MR, pb += NR)
+      {
+        SIMD<T,W> b[NV];
+        for (size_t j = 0; j < NV; j++)
+          b[j] = SIMD<T,W>(pb+j*W);
+        for (size_t i = 0; i < MR; i++)
+          {
+            SIMD<T,W> ai(pa[i]);
+            for (size_t j = 0; j < NV; j++)
+              acc[i][j] = FMA(ai, b[j], acc[i][j]);
+          }
+      }
+
+    SIMD<T,W> valpha(alpha);
+    if (csc == 1)
+      {
+        for (size_t i = 0; i < mr; i++)
+          for (size_t j = 0; j < NV && j*W < nr; j++)
+            {
+              T* cij = c + i*rsc + j*W;
+              size_t n = Min(W, nr-j*W);
+              FMA(valpha, acc[i][j], SIMD<T,W>(cij, n)).Store(cij, n);
+            }
+        return;
+      }
+
+    T tmp[MR][NR];
+    for (size_t i = 0; i < MR; i++)
+      for (size_t j = 0; j < NV; j++)
+        acc[i][j].Store(&tmp[i][j*W]);
+    for (size_t j = 0; j < nr; j++)
+      for (size_t i = 0; i < mr; i++)
+        c[i*rsc+j*csc] += alpha * tmp[i][j];
+  }
+
+  // c(0:mc, 0:nc) += alpha * pa * pb for a packed A-block and B-panel
+  template <typename T, size_t MR, size_t NR>
+  void MacroKernel (size_t mc, size_t nc, size_t kc, const T* pa, const T* pb,
+                    T alpha, T* c, size_t rsc, size_t csc)
+  {
+    for (size_t jr = 0; jr < nc; jr += NR)
+      for (size_t ir = 0; ir < mc; ir += MR)
+        MicroKernel<T,MR,NR> (kc, pa + ir*kc, pb + jr*kc, alpha,
+                              c + ir*rsc + jr*csc, rsc, csc,
+                              Min(MR, mc-ir), Min(NR, nc-jr));
+  }
+
+
+  // ************************* transpose kernels *******************
+
+  // block size of register transposes, 1 for types without SIMD support
+  template <typename T>
+  constexpr size_t TransposeWidth() { return std::is_floating_point_v<T> ? SimdWidth<T>() : 1; }
+
+  // b = alpha * a^T for one W x W block
+  template <size_t W, typename T>
+  inline void TransposeBlock (T alpha, const T* a, size_t lda, T* b, size_t ldb)
+  {
+    SIMD<T,W> r[W];
+    for (size_t k = 0; k < W; k++)
+      r[k] = SIMD<T,W>(alpha) * SIMD<T,W>(a+k*lda);
+    Transpose (r);
+    for (size_t k = 0; k < W; k++)
+      r[k].Store (b+k*ldb);
+  }
+
+  template <typename T>
+  void TransposeTile (size_t m, size_t n, T alpha, const T* a, size_t lda, T* b, size_t ldb)
+  {
+    constexpr size_t W = TransposeWidth<T>();
+    size_t i = 0;
+    if constexpr (W > 1)
+      for ( ; i+W <= m; i += W)
+        {
+          size_t j = 0;
+          for ( ; j+W <= n; j += W)
+            TransposeBlock<W> (alpha, a+i*lda+j, lda, b+j*ldb+i, ldb);
+          for ( ; j < n; j++)
+            for (size_t k = i; k < i+W; k++)
+              b[j*ldb+k] = alpha * a[k*lda+j];
+        }
+    for ( ; i < m; i++)
+      for (size_t j = 0; j < n; j++)
+        b[j*ldb+i] = alpha * a[i*lda+j];
+  }
+
+  // halve the longer side until a tile is reached, splits are multiples of W
+  template <typename T>
+  void TransposeRec (size_t m, size_t n, T alpha, const T* a, size_t lda, T* b, size_t ldb)
+  {
+    constexpr size_t W = TransposeWidth<T>();
+    if (m <= TRANSPOSE_TILE && n <= TRANSPOSE_TILE)
+      {
+        TransposeTile (m, n, alpha, a, lda, b, ldb);
+        return;
+      }
+    if (m >= n)
+      {
+        size_t m1 = m/2 / W * W;
+        TransposeRec (m1, n, alpha, a, lda, b, ldb);
+        TransposeRec (m-m1, n, alpha, a+m1*lda, lda, b+m1, ldb);
+      }
+    else
+      {
+        size_t n1 = n/2 / W * W;
+        TransposeRec (m, n1, alpha, a, lda, b, ldb);
+        TransposeRec (m, n-n1, alpha, a+n1, lda, b+n1*ldb, ldb);
+      }
+  }
+
+
+  // ************************* LU panel *******************
+
+  // a is m x n (m >= n) with row- and column-distance rs, cs, row j is exchanged with ipiv[j]
+  template <typename T>
+  bool LUPanel (size_t m, size_t n, T* a, size_t rs, size_t cs, size_t* ipiv)
+  {
+    for (size_t j = 0; j < n; j++)
+      {
+        // pivot search
+        size_t p = j;
+        auto maxval = Abs(a[j*rs+j*cs]);
+        for (size_t i = j+1; i < m; i++)
+          if (Abs(a[i*rs+j*cs]) > maxval)
+            {
+              p = i;
+              maxval = Abs(a[i*rs+j*cs]);
+            }
+        if (maxval == 0)
+          return false;
+
+        ipiv[j] = p;
+        if (p != j)
+          for (size_t k = 0; k < n; k++)
+            Swap (a[j*rs+k*cs], a[p*rs+k*cs]);
+
+        T inv = T(1) / a[j*rs+j*cs];
+        const T* aj = a + j*rs;
+        for (size_t i = j+1; i < m; i++)
+          {
+            T* ai = a + i*rs;
+            T f = ai[j*cs] *= inv;
+            for (size_t k = j+1; k < n; k++)
+              ai[k*cs] -= f * aj[k*cs];
+          }
+      }
+    return true;
+  }
+
+
+  template <typename T, size_t MR, size_t NR>
+  constexpr GemmTileKernels<T> GemmTile()
+  {
+    return { MR, NR, &PackA<T,MR>, &PackB<T,NR>, &MacroKernel<T,MR,NR> };
+  }
+
+  template <typename T>
+  const KernelTable<T>& NativeKernels()
+  {
+    using MT = GemmMicroTiles<T>;
+    static constexpr KernelTable<T> table
+      {
+        CompiledISA(), SIMD_BYTES,
+        { GemmTile<T,MT::MR[0],MT::NR[0]>(), GemmTile<T,MT::MR[1],MT::NR[1]>(),
+          GemmTile<T,MT::MR[2],MT::NR[2]>() },
+        &DotRange<T>, &AxpyRange<T>,
+        &TransposeRec<T>,
+        &LUPanel<T>
+      };
+    return table;
+  }
+
+}
+
+
+#ifdef NANOBLAS_DISPATCH
+  // selected at the first call, dispatch.cpp
+  template <typename T> const KernelTable<T>& DispatchedKernels();
+  template <> const KernelTable<double>& DispatchedKernels<double>();
+  template <> const KernelTable<float>& DispatchedKernels<float>();
+#endif
+
+  template <typename T>
+  const KernelTable<T>& Kernels()
+  {
+#ifdef NANOBLAS_DISPATCH
+    if constexpr (std::is_same_v<T,double> || std::is_same_v<T,float>)
+      return DispatchedKernels<T>();
+    else
+#endif
+      return NativeKernels<T>();
+  }
+
+  inline ISA GetISA() { return Kernels<double>().isa; }
+
+}
+
+#endif
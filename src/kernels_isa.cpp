@@ -0,0 +1,19 @@
+/*
+  Kernel tables of one instruction set for the nanoblas_kernels library.
+
+  Compiled once per instruction set, with the compiler flags of the
+  instruction set and NANOBLAS_ISA = dispatch_sse2, dispatch_avx2 or
+  dispatch_avx512 (see CMakeLists.txt). Only the kernels are
+  instantiated here: no task manager, no containers.
+*/
+
+#include "kernels.hpp"
+
+namespace nanoblas
+{
+inline namespace NANOBLAS_ISA
+{
+  template const KernelTable<double>& NativeKernels<double>();
+  template const KernelTable<float>& NativeKernels<float>();
+}
+}
@@ -4,6 +4,7 @@
 #include <iostream>
 #include <string>
 #include <algorithm>
+#include <stdexcept>
 
 #include "vector.hpp"
 #include "matrix.hpp"
@@ -46,6 +47,7 @@ namespace nanoblas
   template <typename SX, typename SY>
   void AddVectorLapack (double alpha, VectorView<double,SX> x, VectorView<double,SY> y)
   {
+    NANOBLAS_PROFILE_KERNEL("lapack_axpy", 2.0*x.size(), 3*x.size()*sizeof(double));
     integer n = x.size();
     integer incx = x.dist();
     integer incy = y.dist();
@@ -66,6 +68,8 @@ namespace nanoblas
                          double beta, 
                          VectorView<T,size_t> y)
   {
+    NANOBLAS_PROFILE_KERNEL("lapack_gemv", 2.0*a.rows()*a.cols(),
+                            sizeof(T) * (a.rows()*a.cols() + a.cols() + 2*a.rows()));
     char transa = (ORD == ColMajor) ? 'N' : 'T';
 
     integer n = a.rows();
@@ -120,6 +124,8 @@ namespace nanoblas
                          MatrixView<T, OB> b,
                          MatrixView<T, ColMajor> c)
   {
+    NANOBLAS_PROFILE_KERNEL("lapack_gemm", 2.0*c.rows()*c.cols()*a.cols(),
+                            sizeof(T) * (a.rows()*a.cols() + b.rows()*b.cols() + c.rows()*c.cols()));
     char transa_ = (OA == ColMajor) ? 'N' : 'T';
     char transb_ = (OB == ColMajor) ? 'N' : 'T'; 
   
@@ -162,6 +168,7 @@ namespace nanoblas
       : a(std::move(_a)), ipiv(a.rows()) {
       integer m = a.rows();
       if (m == 0) return;
+      NANOBLAS_PROFILE_KERNEL("lapack_getrf", 2.0/3*m*m*m, 2.0*m*m*sizeof(double));
       integer n = a.cols();
       integer lda = a.dist();
       integer info;
@@ -174,6 +181,8 @@ namespace nanoblas
     
     // b overwritten with A^{-1} b
     void solve (VectorView<double> b) const {
+      NANOBLAS_PROFILE_KERNEL("lapack_getrs", 2.0*a.rows()*a.rows(),
+                              sizeof(double) * (a.rows()*a.rows() + 2*b.size()));
       char transa =  (ORD == ColMajor) ? 'N' : 'T';
       integer n = a.rows();
       integer nrhs = 1;
@@ -187,11 +196,29 @@ namespace nanoblas
 
       dgetrs_(&transa, &n, &nrhs, a.data(), &lda, (integer*)ipiv.data(), b.data(), &ldb, &info);
     }
+
+    // b overwritten with A^{-1} b, all columns of b in one call
+    template <ORDERING OB>
+    void solve (MatrixView<double,OB> b) const {
+      solveLapack ( (ORD == ColMajor) ? 'N' : 'T', b);
+    }
+
+    // b overwritten with A^{-T} b, using the same factorization
+    void solveTrans (VectorView<double> b) const {
+      solveTrans (MatrixView<double,ColMajor> (b.size(), 1, b.data()));
+    }
+
+    // b overwritten with A^{-T} b, all columns of b in one call
+    template <ORDERING OB>
+    void solveTrans (MatrixView<double,OB> b) const {
+      solveLapack ( (ORD == ColMajor) ? 'T' : 'N', b);
+    }
   
     Matrix<double,ORD> inverse() && {
       double hwork;
       integer lwork = -1;
       integer n = a.rows();      
+      NANOBLAS_PROFILE_KERNEL("lapack_getri", 4.0/3*n*n*n, 2.0*n*n*sizeof(double));
       integer lda = a.dist();
       integer info;
 
@@ -207,10 +234,129 @@ namespace nanoblas
       return std::move(a);      
     }
 
+  private:
+    template <ORDERING OB>
+    void solveLapack (char transa, MatrixView<double,OB> b) const {
+      assert(b.rows() == a.rows());
+      if (b.rows() == 0 || b.cols() == 0) return;
+
+      if constexpr (OB == RowMajor)
+        {
+          // dgetrs needs column-major right hand sides
+          Matrix<double,ColMajor> tmp(b.rows(), b.cols());
+          tmp = b;
+          solveLapack (transa, tmp);
+          b = tmp;
+        }
+      else
+        {
+          NANOBLAS_PROFILE_KERNEL("lapack_getrs", 2.0*a.rows()*a.rows()*b.cols(),
+                                  sizeof(double) * (a.rows()*a.rows() + 2*b.rows()*b.cols()));
+          integer n = a.rows();
+          integer nrhs = b.cols();
+          integer lda = a.dist();
+          integer ldb = std::max<size_t>(b.dist(), 1);
+          integer info;
+          dgetrs_(&transa, &n, &nrhs, a.data(), &lda, (integer*)ipiv.data(), b.data(), &ldb, &info);
+        }
+    }
+    
+  public:
     // Matrix<double,ORD> LFactor() const { ... }
     // Matrix<double,ORD> UFactor() const { ... }
     // Matrix<double,ORD> PFactor() const { ... }
   };
+
+
+  
+  template <ORDERING ORD>
+  class LapackCholesky {
+    Matrix <double, ORD> a;
+
+    // the lower triangle of a: for RowMajor it is the upper one of the column-major storage
+    static char Uplo() { return (ORD == ColMajor) ? 'L' : 'U'; }
+    
+  public:
+    LapackCholesky (Matrix<double,ORD> _a)
+      : a(std::move(_a)) {
+      if (a.rows() != a.cols())
+        throw std::invalid_argument("Cholesky: Matrix must be square");
+      integer n = a.rows();
+      if (n == 0) return;
+      NANOBLAS_PROFILE_KERNEL("lapack_potrf", 1.0/3*n*n*n, 2.0*n*n*sizeof(double));
+      char uplo = Uplo();
+      integer lda = a.dist();
+      integer info;
+
+      // int dpotrf_(char *uplo, integer *n, doublereal *a, integer *lda, 
+      //             integer *info);
+
+      dpotrf_(&uplo, &n, a.data(), &lda, &info);
+      if (info > 0)
+        throw std::runtime_error("Cholesky: Matrix not positive definite");
+    }
+
+    // b overwritten with A^{-1} b
+    void solve (VectorView<double> b) const {
+      solve (MatrixView<double,ColMajor> (b.size(), 1, b.data()));
+    }
+
+    // b overwritten with A^{-1} b, all columns of b in one call
+    template <ORDERING OB>
+    void solve (MatrixView<double,OB> b) const {
+      assert(b.rows() == a.rows());
+      if (b.rows() == 0 || b.cols() == 0) return;
+
+      if constexpr (OB == RowMajor)
+        {
+          // dpotrs needs column-major right hand sides
+          Matrix<double,ColMajor> tmp(b.rows(), b.cols());
+          tmp = b;
+          solve (MatrixView<double,ColMajor>(tmp));
+          b = tmp;
+        }
+      else
+        {
+          NANOBLAS_PROFILE_KERNEL("lapack_potrs", 2.0*a.rows()*a.rows()*b.cols(),
+                                  sizeof(double) * (a.rows()*a.rows() + 2*b.rows()*b.cols()));
+          char uplo = Uplo();
+          integer n = a.rows();
+          integer nrhs = b.cols();
+          integer lda = a.dist();
+          integer ldb = std::max<size_t>(b.dist(), 1);
+          integer info;
+
+          // int dpotrs_(char *uplo, integer *n, integer *nrhs, 
+          //             doublereal *a, integer *lda, doublereal *b, 
+          //             integer *ldb, integer *info);
+
+          dpotrs_(&uplo, &n, &nrhs, a.data(), &lda, b.data(), &ldb, &info);
+        }
+    }
+
+    Matrix<double,ORD> inverse() && {
+      integer n = a.rows();
+      if (n == 0) return std::move(a);
+      NANOBLAS_PROFILE_KERNEL("lapack_potri", 2.0/3*n*n*n, 2.0*n*n*sizeof(double));
+      char uplo = Uplo();
+      integer lda = a.dist();
+      integer info;
+
+      // int dpotri_(char *uplo, integer *n, doublereal *a, integer *lda, 
+      //             integer *info);
+
+      dpotri_(&uplo, &n, a.data(), &lda, &info);
+
+      // dpotri computes the lower triangle only
+      for (integer i = 0; i < n; i++)
+        for (integer j = 0; j < i; j++)
+          a(j,i) = a(i,j);
+      return std::move(a);
+    }
+
+    // L in the lower triangle, the strictly upper triangle is the one of the input
+    const Matrix<double,ORD>& factor() const { return a; }
+  };
   
 }
 
@@ -0,0 +1,126 @@
+#ifndef FILE_LU
+#define FILE_LU
+
+#include <vector>
+#include <stdexcept>
+#include <cmath>
+
+#include "matrix.hpp"
+#include "triangular.hpp"
+
+namespace nanoblas
+{
+
+  /*
+    Native LU factorization with partial pivoting (getrf):
+
+      P A = L U
+
+    L (unit diagonal) and U overwrite a. Row i was exchanged with
+    row ipiv[i], in the order i = 0, 1, ...
+
+    Recursive algorithm: factor the left half of the columns,
+    apply its exchanges and L11^{-1} to the right half, update the
+    trailing block with the GEMM kernel, and factor it. Panels of at
+    most LU_PANEL columns are factored by the lu_panel kernel.
+  */
+
+  constexpr size_t LU_PANEL = 16;
+
+  // exchange rows i and ipiv[i] for i in [first, next)
+  template <typename T, ORDERING ORD>
+  void SwapRows (MatrixView<T,ORD> a, const size_t* ipiv, size_t first, size_t next)
+  {
+    for (size_t i = first; i < next; i++)
+      if (ipiv[i] != i)
+        for (size_t j = 0; j < a.cols(); j++)
+          std::swap (a(i,j), a(ipiv[i],j));
+  }
+
+  // a is m x n with m >= n, ipiv has n entries, relative to the rows of a
+  template <typename T, ORDERING ORD>
+  void LUFactor (MatrixView<T,ORD> a, size_t* ipiv)
+  {
+    size_t m = a.rows(), n = a.cols();
+
+    if (n <= LU_PANEL)
+      {
+        size_t rs = (ORD==RowMajor) ? a.dist() : 1, cs = (ORD==RowMajor) ? 1 : a.dist();
+        if (!Kernels<T>().lu_panel (m, n, a.data(), rs, cs, ipiv))
+          throw std::runtime_error("LU: Matrix singular");
+        return;
+      }
+
+    size_t n1 = n/2;
+    auto left = a.cols(0,n1);
+    auto right = a.cols(n1,n);
+
+    LUFactor (left, ipiv);
+    SwapRows (right, ipiv, 0, n1);
+    TriangularSolve<Lower,Unit> (a.rows(0,n1).cols(0,n1), right.rows(0,n1));
+    AddMultMatMat (T(-1), left.rows(n1,m), right.rows(0,n1), right.rows(n1,m));
+
+    LUFactor (right.rows(n1,m), ipiv+n1);
+    for (size_t i = n1; i < n; i++)
+      ipiv[i] += n1;
+    SwapRows (left, ipiv, n1, n);
+  }
+
+
+
+  template <typename T=double, ORDERING ORD=RowMajor>
+  class LU
+  {
+    Matrix<T,ORD> a;
+    std::vector<size_t> ipiv;
+
+  public:
+    LU (Matrix<T,ORD> _a)
+      : a(std::move(_a)), ipiv(a.rows())
+    {
+      if (a.rows() != a.cols())
+        throw std::invalid_argument("LU: Matrix must be square");
+      NANOBLAS_PROFILE_KERNEL("lu", 2.0/3*a.rows()*a.rows()*a.rows(), 2.0*a.rows()*a.rows()*sizeof(T));
+      LUFactor<T,ORD> (a, ipiv.data());
+    }
+
+    size_t size() const { return a.rows(); }
+
+    // b overwritten with A^{-1} b, for all columns of b
+    template <ORDERING OB>
+    void solve (MatrixView<T,OB> b) const
+    {
+      assert(b.rows() == a.rows());
+      NANOBLAS_PROFILE_KERNEL("lu_solve", 2.0*a.rows()*a.rows()*b.cols(),
+                              sizeof(T) * (a.rows()*a.rows() + 2*b.rows()*b.cols()));
+      SwapRows (b, ipiv.data(), 0, ipiv.size());
+      TriangularSolve<Lower,Unit> (MatrixView<T,ORD>(a), b);
+      TriangularSolve<Upper,NonUnit> (MatrixView<T,ORD>(a), b);
+    }
+
+    // b overwritten with A^{-1} b
+    template <typename TDIST>
+    void solve (VectorView<T,TDIST> b) const
+    {
+      solve (MatrixView<T,RowMajor> (b.size(), 1, b.dist(), b.data()));
+    }
+
+    Matrix<T,ORD> inverse() const
+    {
+      size_t n = a.rows();
+      Matrix<T,ORD> inv(n,n);
+      inv = T(0);
+      for (size_t i = 0; i < n; i++)
+        inv(i,i) = T(1);
+      solve (inv);
+      return inv;
+    }
+
+    // the factors are stored in one matrix: unit lower triangle L, upper triangle U
+    const Matrix<T,ORD>& factors() const { return a; }
+    const std::vector<size_t>& pivots() const { return ipiv; }
+  };
+
+}
+
+#endif
@@ -2,6 +2,7 @@
 #define FILE_MATEXPR
 
 #include <cstddef>
+#include <array>
 #include <iostream>
 
 #include "vecexpr.hpp"
@@ -21,7 +22,7 @@ namespace nanoblas
   class MatExpr
   {
   public:
-    auto derived() const { return static_cast<const T&> (*this); }
+    const T& derived() const { return static_cast<const T&> (*this); }
     size_t rows() const { return derived().rows(); }
     size_t cols() const { return derived().cols(); }
     auto shape() const { return derived().shape(); }
@@ -52,7 +53,9 @@ namespace nanoblas
     TB b;
   public:
     SumMatExpr (TA _a, TB _b) : a(_a), b(_b) { }
-    auto operator() (size_t i) const { return a(i)+b(i); }
+    bool Overlaps (const MemoryRange& t, bool entrywise) const
+    { return ExprOverlaps(a, t, entrywise) || ExprOverlaps(b, t, entrywise); }
+    auto operator() (size_t i, size_t j) const { return a(i,j)+b(i,j); }
     size_t rows() const { return a.rows(); }
     size_t cols() const { return a.cols(); }  
     auto shape() const { return a.shape(); }    
@@ -62,7 +65,7 @@ namespace nanoblas
   auto operator+ (const MatExpr<TA>& a, const MatExpr<TB>& b)
   {
     assert(a.rows()==b.rows() && a.cols()==b.cols());
-    return SumMatExpr(a.derived(), b.derived());
+    return SumMatExpr<expr_storage_t<TA>,expr_storage_t<TB>>(a.derived(), b.derived());
   }
 
 
@@ -76,9 +79,14 @@ namespace nanoblas
     TM m_mat;
   public:
     ScaleMatExpr (TSCAL scal, TM mat) : m_scal(scal), m_mat(mat) { }
+    TSCAL Scal() const { return m_scal; }
+    const TM& Expr() const { return m_mat; }
+    bool Overlaps (const MemoryRange& t, bool entrywise) const
+    { return ExprOverlaps(m_mat, t, entrywise); }
     auto operator() (size_t i, size_t j) const { return m_scal*m_mat(i,j); }
     size_t rows() const { return m_mat.rows(); }
     size_t cols() const { return m_mat.cols(); }  
+    auto shape() const { return m_mat.shape(); }
   };
 
 
@@ -90,7 +98,7 @@ namespace nanoblas
   template <typename TSCAL, typename T> requires (isScalar<TSCAL>())
   auto operator* (TSCAL scal, const MatExpr<T>& m)
   {
-    return ScaleMatExpr(scal, m.derived());
+    return ScaleMatExpr<TSCAL,expr_storage_t<T>>(scal, m.derived());
   }
   
   
@@ -104,6 +112,11 @@ namespace nanoblas
     TB b;
   public:
     MultMatMatExpr (TA _a, TB _b) : a(_a), b(_b) { }
+    const TA& A() const { return a; }
+    const TB& B() const { return b; }
+    // every entry reads rows/columns of the operands
+    bool Overlaps (const MemoryRange& t, bool /* entrywise */) const
+    { return ExprOverlaps(a, t, false) || ExprOverlaps(b, t, false); }
     size_t rows() const { return a.rows(); }
     size_t cols() const { return b.cols(); }
     auto shape() const { return std::array<size_t,2>{a.shape()[0], b.shape()[1]}; }
@@ -127,7 +140,7 @@ namespace nanoblas
   auto operator* (const MatExpr<TA>& a, const MatExpr<TB>& b)
   {
     assert(a.cols()==b.rows());
-    return MultMatMatExpr<TA,TB>(a.derived(), b.derived());
+    return MultMatMatExpr<expr_storage_t<TA>,expr_storage_t<TB>>(a.derived(), b.derived());
   }
   
 
@@ -141,6 +154,11 @@ namespace nanoblas
     TB b;
   public:
     MultMatVecExpr (TA _a, TB _b) : a(_a), b(_b) { }
+    const TA& A() const { return a; }
+    const TB& B() const { return b; }
+    // every entry reads rows/columns of the operands
+    bool Overlaps (const MemoryRange& t, bool /* entrywise */) const
+    { return ExprOverlaps(a, t, false) || ExprOverlaps(b, t, false); }
     size_t size() const { return a.rows(); }
     
     // auto operator() (size_t i) const { return dot(a.row(i), b); }
@@ -161,7 +179,7 @@ namespace nanoblas
   auto operator* (const MatExpr<TA>& a, const VecExpr<TB>& b)
   {
     assert(a.cols()==b.size());    
-    return MultMatVecExpr<TA,TB>(a.derived(), b.derived());
+    return MultMatVecExpr<expr_storage_t<TA>,expr_storage_t<TB>>(a.derived(), b.derived());
   }
  
 
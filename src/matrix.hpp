@@ -1,14 +1,140 @@
 #ifndef FILE_MATRIX
 #define FILE_MATRIX
 
+#include <utility>
+#include <tuple>
+#include <cmath>
+
 #include "matexpr.hpp"
 #include "vector.hpp"
+#include "gemm.hpp"
+#include "tuning.hpp"
+#include "transpose.hpp"
 
 namespace nanoblas
 {
   
   // enum ORDERING { RowMajor, ColMajor };
 
+  template <typename T, ORDERING OA, ORDERING OB, ORDERING OC>
+  void AddMultMatMat (T alpha, MatrixView<T,OA> a, MatrixView<T,OB> b, MatrixView<T,OC> c);
+
+  template <typename T, ORDERING OA, ORDERING OB>
+  void CopyMatrix (T alpha, MatrixView<T,OA> a, MatrixView<T,OB> b);
+
+  template <typename T, ORDERING ORD>
+  void TransposeInPlace (MatrixView<T,ORD> a);
+
+  template <typename T, ORDERING ORD, typename TALLOC>
+  class Matrix;
+
+
+  /*
+    Expression patterns evaluated by the GEMM/GEMV kernels (or BLAS),
+    for views of element type T:
+
+      matview_pattern       A, s*A                              -> (s, A)
+      gemm_pattern          A*B of scaled views, s*(A*B)        -> (s, A, B)
+      gemv_pattern          A*x of scaled views, s*(A*x)        -> (s, A, x)
+      gemv_update_pattern   gemv + t*y, t*y + gemv              -> (s, A, x, t, y)
+
+    Split(e) returns the tuple of scalars and views.
+  */
+
+  template <typename TE, typename T>
+  struct matview_pattern : std::false_type { };
+
+  template <typename T, ORDERING ORD>
+  struct matview_pattern<MatrixView<T,ORD>, T> : std::true_type
+  {
+    static auto Split (const MatrixView<T,ORD>& a) { return std::tuple(T(1), a); }
+  };
+
+  template <typename TSCAL, typename TM, typename T>
+    requires (matview_pattern<TM,T>::value && std::is_convertible_v<TSCAL,T>)
+  struct matview_pattern<ScaleMatExpr<TSCAL,TM>, T> : std::true_type
+  {
+    static auto Split (const ScaleMatExpr<TSCAL,TM>& e)
+    {
+      auto [s, a] = matview_pattern<TM,T>::Split(e.Expr());
+      return std::tuple(T(e.Scal())*s, a);
+    }
+  };
+
+  template <typename TE, typename T>
+  struct gemm_pattern : std::false_type { };
+
+  template <typename TA, typename TB, typename T>
+    requires (matview_pattern<TA,T>::value && matview_pattern<TB,T>::value)
+  struct gemm_pattern<MultMatMatExpr<TA,TB>, T> : std::true_type
+  {
+    static auto Split (const MultMatMatExpr<TA,TB>& e)
+    {
+      auto [sa, a] = matview_pattern<TA,T>::Split(e.A());
+      auto [sb, b] = matview_pattern<TB,T>::Split(e.B());
+      return std::tuple(sa*sb, a, b);
+    }
+  };
+
+  template <typename TSCAL, typename TM, typename T>
+    requires (gemm_pattern<TM,T>::value && std::is_convertible_v<TSCAL,T>)
+  struct gemm_pattern<ScaleMatExpr<TSCAL,TM>, T> : std::true_type
+  {
+    static auto Split (const ScaleMatExpr<TSCAL,TM>& e)
+    {
+      auto [s, a, b] = gemm_pattern<TM,T>::Split(e.Expr());
+      return std::tuple(T(e.Scal())*s, a, b);
+    }
+  };
+
+  template <typename TA, typename TX, typename T>
+    requires (matview_pattern<TA,T>::value && vecview_pattern<TX,T>::value)
+  struct gemv_pattern<MultMatVecExpr<TA,TX>, T> : std::true_type
+  {
+    static auto Split (const MultMatVecExpr<TA,TX>& e)
+    {
+      auto [sa, a] = matview_pattern<TA,T>::Split(e.A());
+      auto [sx, x] = vecview_pattern<TX,T>::Split(e.B());
+      return std::tuple(sa*sx, a, x);
+    }
+  };
+
+  template <typename TSCAL, typename TV, typename T>
+    requires (gemv_pattern<TV,T>::value && std::is_convertible_v<TSCAL,T>)
+  struct gemv_pattern<ScaleVecExpr<TSCAL,TV>, T> : std::true_type
+  {
+    static auto Split (const ScaleVecExpr<TSCAL,TV>& e)
+    {
+      auto [s, a, x] = gemv_pattern<TV,T>::Split(e.Expr());
+      return std::tuple(T(e.Scal())*s, a, x);
+    }
+  };
+
+  template <typename TA, typename TB, typename T>
+    requires (gemv_pattern<TA,T>::value && vecview_pattern<TB,T>::value)
+  struct gemv_update_pattern<SumVecExpr<TA,TB>, T> : std::true_type
+  {
+    static auto Split (const SumVecExpr<TA,TB>& e)
+    {
+      auto [s, a, x] = gemv_pattern<TA,T>::Split(e.A());
+      auto [t, y] = vecview_pattern<TB,T>::Split(e.B());
+      return std::tuple(s, a, x, t, y);
+    }
+  };
+
+  template <typename TA, typename TB, typename T>
+    requires (vecview_pattern<TA,T>::value && gemv_pattern<TB,T>::value)
+  struct gemv_update_pattern<SumVecExpr<TA,TB>, T> : std::true_type
+  {
+    static auto Split (const SumVecExpr<TA,TB>& e)
+    {
+      auto [s, a, x] = gemv_pattern<TB,T>::Split(e.B());
+      auto [t, y] = vecview_pattern<TA,T>::Split(e.A());
+      return std::tuple(s, a, x, t, y);
+    }
+  };
+
+
   template <typename T, ORDERING ORD>
   class MatrixView : public MatExpr<MatrixView<T,ORD>>
   {
@@ -41,15 +167,75 @@ namespace nanoblas
 
     MatrixView& operator= (const MatrixView& m2)
     {
-      for (size_t i = 0; i < m_rows; i++)
-        for (size_t j = 0; j < m_cols; j++)
-          (*this)(i,j) = m2(i,j);
-      return *this;
+      return *this = static_cast<const MatExpr<MatrixView>&>(m2);
     }
-    
+
+    // memory of the matrix, for alias analysis
+    MemoryRange Range() const
+    {
+      return (ORD==RowMajor) ? MemoryRange::Of(m_data, m_rows, m_cols, m_dist, 1)
+        : MemoryRange::Of(m_data, m_rows, m_cols, 1, m_dist);
+    }
+    bool Overlaps (const MemoryRange& t, bool entrywise) const { return Range().LeafOverlaps(t, entrywise); }
+
+    // assignments evaluate via a temporary if the expression reads this matrix
     template <typename TB>
     MatrixView& operator= (const MatExpr<TB>& m2)
     {
+      // A = s*trans(A) in place for square A
+      if constexpr (matview_pattern<TB,T>::value)
+        {
+          auto [s, a] = matview_pattern<TB,T>::Split(m2.derived());
+          MemoryRange ra = a.Range(), rt = Range();
+          if (m_rows == m_cols && ra.data == rt.data && ra.rs == rt.cs && ra.cs == rt.rs)
+            {
+              TransposeInPlace (*this);
+              if (s != T(1)) *this *= s;
+              return *this;
+            }
+        }
+      if (ExprOverlaps(m2.derived(), Range(), true))
+        return AssignNoAlias(Matrix<T,ORD,AlignedAllocator<T>>(m2));
+      return AssignNoAlias(m2);
+    }
+
+    template <typename TB>
+    MatrixView& operator+= (const MatExpr<TB>& m2)
+    {
+      if (ExprOverlaps(m2.derived(), Range(), true))
+        return AddNoAlias(Matrix<T,ORD,AlignedAllocator<T>>(m2));
+      return AddNoAlias(m2);
+    }
+
+    template <typename TB>
+    MatrixView& operator-= (const MatExpr<TB>& m2)
+    {
+      if (ExprOverlaps(m2.derived(), Range(), true))
+        return SubNoAlias(Matrix<T,ORD,AlignedAllocator<T>>(m2));
+      return SubNoAlias(m2);
+    }
+
+    template <typename TB>
+    MatrixView& AssignNoAlias (const MatExpr<TB>& m2)
+    {
+      // A = s*B, line by line or by the tiled transpose kernel if orderings differ
+      if constexpr (matview_pattern<TB,T>::value)
+        {
+          auto [s, a] = matview_pattern<TB,T>::Split(m2.derived());
+          CopyMatrix (s, a, *this);
+          return *this;
+        }
+
+      // C = s*A*B by the GEMM kernel
+      if constexpr (gemm_pattern<TB,T>::value)
+        {
+          auto [s, a, b] = gemm_pattern<TB,T>::Split(m2.derived());
+          *this = T(0);
+          AddMultMatMat (s, a, b, *this);
+          return *this;
+        }
+      
+      NANOBLAS_PROFILE_KERNEL("mat_assign", 0, m_rows*m_cols*sizeof(T));
       for (size_t i = 0; i < m_rows; i++)
         for (size_t j = 0; j < m_cols; j++)
           (*this)(i,j) = m2(i,j);
@@ -82,8 +268,15 @@ namespace nanoblas
 
 
     template <typename TB>
-    MatrixView& operator+= (const MatExpr<TB>& m2)
+    MatrixView& AddNoAlias (const MatExpr<TB>& m2)
     {
+      if constexpr (gemm_pattern<TB,T>::value)
+        {
+          auto [s, a, b] = gemm_pattern<TB,T>::Split(m2.derived());
+          AddMultMatMat (s, a, b, *this);
+          return *this;
+        }
+      NANOBLAS_PROFILE_KERNEL("mat_update", m_rows*m_cols, 2*m_rows*m_cols*sizeof(T));
       for (size_t i = 0; i < m_rows; i++)
         for (size_t j = 0; j < m_cols; j++)
           (*this)(i,j) += m2(i,j);
@@ -91,8 +284,15 @@ namespace nanoblas
     }
     
     template <typename TB>
-    MatrixView& operator-= (const MatExpr<TB>& m2)
+    MatrixView& SubNoAlias (const MatExpr<TB>& m2)
     {
+      if constexpr (gemm_pattern<TB,T>::value)
+        {
+          auto [s, a, b] = gemm_pattern<TB,T>::Split(m2.derived());
+          AddMultMatMat (-s, a, b, *this);
+          return *this;
+        }
+      NANOBLAS_PROFILE_KERNEL("mat_update", m_rows*m_cols, 2*m_rows*m_cols*sizeof(T));
       for (size_t i = 0; i < m_rows; i++)
         for (size_t j = 0; j < m_cols; j++)
           (*this)(i,j) -= m2(i,j);
@@ -141,6 +341,9 @@ namespace nanoblas
   };
 
 
+  template <typename T, ORDERING ORD>
+  auto noalias (MatrixView<T,ORD> m) { return NoAlias<MatrixView<T,ORD>>(m); }
+
   template <typename T, ORDERING ORD>
   auto trans (MatrixView<T,ORD> mat)
   {
@@ -150,26 +353,119 @@ namespace nanoblas
       return MatrixView<T,RowMajor>(mat.cols(), mat.rows(), mat.dist(), mat.data());
   }
   
-  template <typename T=double, ORDERING ORD=RowMajor>
+  // c += alpha*a*b, using BLAS if enabled, otherwise the native blocked kernel with tuned parameters
+  template <typename T, ORDERING OA, ORDERING OB, ORDERING OC>
+  void AddMultMatMat (T alpha, MatrixView<T,OA> a, MatrixView<T,OB> b, MatrixView<T,OC> c)
+  {
+    assert(a.cols()==b.rows() && c.rows()==a.rows() && c.cols()==b.cols());
+    NANOBLAS_PROFILE_KERNEL("gemm", 2.0*c.rows()*c.cols()*a.cols(),
+                            sizeof(T) * (a.rows()*a.cols() + b.rows()*b.cols() + 2*c.rows()*c.cols()));
+    size_t rsa = (OA==RowMajor) ? a.dist() : 1, csa = (OA==RowMajor) ? 1 : a.dist();
+    size_t rsb = (OB==RowMajor) ? b.dist() : 1, csb = (OB==RowMajor) ? 1 : b.dist();
+    size_t rsc = (OC==RowMajor) ? c.dist() : 1, csc = (OC==RowMajor) ? 1 : c.dist();
+    if (BlasGemm (c.rows(), c.cols(), a.cols(), alpha, a.data(), rsa, csa,
+                  b.data(), rsb, csb, c.data(), rsc, csc))
+      return;
+    GemmKernel (c.rows(), c.cols(), a.cols(), alpha, a.data(), rsa, csa,
+                b.data(), rsb, csb, c.data(), rsc, csc, GemmParameters<T>());
+  }
+
+  // y += alpha*a*x, using BLAS if enabled, otherwise the native kernel
+  template <typename T, ORDERING ORD, typename TDX, typename TDY>
+  void AddMultMatVec (T alpha, MatrixView<T,ORD> a, VectorView<T,TDX> x, VectorView<T,TDY> y)
+  {
+    assert(a.cols()==x.size() && a.rows()==y.size());
+    NANOBLAS_PROFILE_KERNEL("gemv", 2.0*a.rows()*a.cols(), sizeof(T) * (a.rows()*a.cols() + a.cols() + 2*a.rows()));
+    size_t rsa = (ORD==RowMajor) ? a.dist() : 1, csa = (ORD==RowMajor) ? 1 : a.dist();
+    if (BlasGemv (a.rows(), a.cols(), alpha, a.data(), rsa, csa,
+                  x.data(), size_t(x.dist()), y.data(), size_t(y.dist())))
+      return;
+    GemvKernel (a.rows(), a.cols(), alpha, a.data(), rsa, csa,
+                x.data(), size_t(x.dist()), y.data(), size_t(y.dist()));
+  }
+
+  // b = alpha*a, by the transpose kernel if the orderings differ
+  template <typename T, ORDERING OA, ORDERING OB>
+  void CopyMatrix (T alpha, MatrixView<T,OA> a, MatrixView<T,OB> b)
+  {
+    assert(a.rows()==b.rows() && a.cols()==b.cols());
+    // the stored array of a is m x n
+    size_t m = (OA==RowMajor) ? a.rows() : a.cols();
+    size_t n = (OA==RowMajor) ? a.cols() : a.rows();
+    if constexpr (OA == OB)
+      {
+        NANOBLAS_PROFILE_KERNEL("copy", 0, 2*m*n*sizeof(T));
+        CopyKernel (m, n, alpha, a.data(), a.dist(), b.data(), b.dist());
+      }
+    else
+      {
+        NANOBLAS_PROFILE_KERNEL("transpose", 0, 2*m*n*sizeof(T));
+        TransposeKernel (m, n, alpha, a.data(), a.dist(), b.data(), b.dist());
+      }
+  }
+
+  // a = trans(a) for square a
+  template <typename T, ORDERING ORD>
+  void TransposeInPlace (MatrixView<T,ORD> a)
+  {
+    assert(a.rows()==a.cols());
+    NANOBLAS_PROFILE_KERNEL("transpose_inplace", 0, 2*a.rows()*a.rows()*sizeof(T));
+    TransposeInPlaceKernel (a.rows(), a.data(), a.dist());
+  }
+
+  // c = a*b
+  template <typename T, ORDERING OA, ORDERING OB, ORDERING OC>
+  void MultMatMat (MatrixView<T,OA> a, MatrixView<T,OB> b, MatrixView<T,OC> c)
+  {
+    c = T(0);
+    AddMultMatMat (T(1), a, b, c);
+  }
+
+  
+  template <typename T=double, ORDERING ORD=RowMajor, typename TALLOC=AlignedAllocator<T>>
   class Matrix : public MatrixView<T,ORD>
   {
     typedef MatrixView<T,ORD> BASE;
     using BASE::m_cols;
     using BASE::m_data;
     using BASE::m_rows;
+    using BASE::m_dist;
 
+    // distance of rows (RowMajor) or columns (ColMajor) as chosen by the allocator
+    static size_t LeadingDim (size_t rows, size_t cols)
+    { return TALLOC::LeadingDim( (ORD==RowMajor) ? cols : rows); }
+
+    static size_t BufferSize (size_t rows, size_t cols)
+    { return LeadingDim(rows, cols) * ( (ORD==RowMajor) ? rows : cols); }
+    
   public:
     Matrix (size_t rows, size_t cols)
-      : BASE(rows, cols, new T[rows*cols]) { }
+      : BASE(rows, cols, LeadingDim(rows, cols), TALLOC::Allocate(BufferSize(rows, cols))) { }
           
     Matrix (const Matrix& m2)
-      : BASE(m2.rows(), m2.cols(), new T[m2.rows()*m2.cols()])
+      : Matrix(m2.rows(), m2.cols())
+    {
+      *this = m2;
+    }
+
+    Matrix (Matrix && m2)
+      : BASE(0, 0, nullptr)
+    {
+      std::swap(m_rows, m2.m_rows);
+      std::swap(m_cols, m2.m_cols);
+      std::swap(m_dist, m2.m_dist);
+      std::swap(m_data, m2.m_data);
+    }
+
+    template <typename TB>
+    Matrix (const MatExpr<TB>& m2)
+      : Matrix(m2.rows(), m2.cols())
     {
       *this = m2;
     }
           
     Matrix (std::initializer_list<std::initializer_list<T>> list)
-      : BASE(list.size(), list.begin()->size(), new T[list.size()*list.begin()->size()])
+      : Matrix(list.size(), list.begin()->size())
     {
       size_t i = 0;
       for (auto row : list)
@@ -184,7 +480,7 @@ namespace nanoblas
         }
     } 
 
-    ~Matrix() { delete[] m_data; }
+    ~Matrix() { TALLOC::Deallocate(m_data, BufferSize(m_rows, m_cols)); }
 
     using BASE::operator=;
     Matrix& operator= (const Matrix& m2)
@@ -196,9 +492,247 @@ namespace nanoblas
         }
       return *this;
     }
+
+    Matrix& operator= (Matrix && m2)
+    {
+      std::swap(m_rows, m2.m_rows);
+      std::swap(m_cols, m2.m_cols);
+      std::swap(m_dist, m2.m_dist);
+      std::swap(m_data, m2.m_data);
+      return *this;
+    }
                     
   };
 
+
+  // ***************** fixed size matrices *********************
+
+  // calls f(integral_constant<size_t,I>) for I = 0 ... N-1, unrolled at compile time
+  template <size_t N, typename F>
+  inline void Unroll (F && f)
+  {
+    [&]<size_t... I> (std::index_sequence<I...>)
+    {
+      (f(std::integral_constant<size_t,I>()), ...);
+    } (std::make_index_sequence<N>());
+  }
+
+  // fully unroll products up to this number of multiply-adds, e.g. 6x6 times 6x6
+  constexpr size_t MAT_UNROLL_LIMIT = 216;
+
+  /*
+    Mat<R,C,T>: matrix of compile-time size, RowMajor on the stack.
+    Small products, determinant and inverse (inverse.hpp) are 
+    unrolled and return fixed size results.
+  */
+  template <size_t R, size_t C, typename T=double>
+  class Mat : public MatExpr<Mat<R,C,T>>
+  {
+    std::array<T, R*C> m_data;
+  public:
+    Mat() = default;
+    Mat (const Mat& m) = default;
+
+    template <typename TB>
+    Mat (const MatExpr<TB>& m)
+    {
+      *this = m;
+    }
+
+    Mat (T val)
+    {
+      m_data.fill(val);
+    }
+
+    Mat (std::initializer_list<std::initializer_list<T>> list)
+    {
+      size_t i = 0;
+      for (auto & row : list)
+        {
+          size_t j = 0;
+          for (auto val : row)
+            (*this)(i,j++) = val;
+          i++;
+        }
+    }
+
+    Mat& operator= (const Mat& m2) = default;
+
+    template <typename TB>
+    Mat& operator= (const MatExpr<TB>& m2)
+    {
+      assert(m2.rows()==R && m2.cols()==C);
+      if (ExprOverlaps(m2.derived(), Range(), true))
+        return *this = Mat(m2);
+      for (size_t i = 0; i < R; i++)
+        for (size_t j = 0; j < C; j++)
+          (*this)(i,j) = m2(i,j);
+      return *this;
+    }
+
+    Mat& operator= (T val)
+    {
+      m_data.fill(val);
+      return *this;
+    }
+
+    MemoryRange Range() const { return MemoryRange::Of(m_data.data(), R, C, C, 1); }
+    bool Overlaps (const MemoryRange& t, bool entrywise) const { return Range().LeafOverlaps(t, entrywise); }
+
+    template <typename TB>
+    Mat& operator+= (const MatExpr<TB>& m2)
+    {
+      assert(m2.rows()==R && m2.cols()==C);
+      if (ExprOverlaps(m2.derived(), Range(), true))
+        return *this += Mat(m2);
+      for (size_t i = 0; i < R; i++)
+        for (size_t j = 0; j < C; j++)
+          (*this)(i,j) += m2(i,j);
+      return *this;
+    }
+
+    template <typename TB>
+    Mat& operator-= (const MatExpr<TB>& m2)
+    {
+      assert(m2.rows()==R && m2.cols()==C);
+      if (ExprOverlaps(m2.derived(), Range(), true))
+        return *this -= Mat(m2);
+      for (size_t i = 0; i < R; i++)
+        for (size_t j = 0; j < C; j++)
+          (*this)(i,j) -= m2(i,j);
+      return *this;
+    }
+
+    Mat& operator*= (T scal)
+    {
+      for (auto & val : m_data)
+        val *= scal;
+      return *this;
+    }
+
+    static constexpr size_t rows() { return R; }
+    static constexpr size_t cols() { return C; }
+    static constexpr size_t dist() { return C; }
+    auto shape() const { return std::array<size_t,2>{R, C}; }
+
+    T* data() { return m_data.data(); }
+    const T* data() const { return m_data.data(); }
+
+    T& operator() (size_t i, size_t j) { return m_data[i*C+j]; }
+    const T& operator() (size_t i, size_t j) const { return m_data[i*C+j]; }
+
+    // views to the stack storage
+    auto view() { return MatrixView<T,RowMajor>(R, C, m_data.data()); }
+    auto view() const { return MatrixView<const T,RowMajor>(R, C, m_data.data()); }
+  };
+
+  // Mat holds its values, expressions refer to it instead of copying
+  template <size_t R, size_t C, typename T>
+  struct expr_storage<Mat<R,C,T>> { using type = const Mat<R,C,T>&; };
+
+
+  template <size_t R, size_t C, typename T>
+  Mat<C,R,T> trans (const Mat<R,C,T>& a)
+  {
+    Mat<C,R,T> res;
+    for (size_t i = 0; i < R; i++)
+      for (size_t j = 0; j < C; j++)
+        res(j,i) = a(i,j);
+    return res;
+  }
+
+  template <size_t R, size_t K, size_t C, typename T>
+  Mat<R,C,T> operator* (const Mat<R,K,T>& a, const Mat<K,C,T>& b)
+  {
+    Mat<R,C,T> res;
+    if constexpr (R*K*C <= MAT_UNROLL_LIMIT)
+      Unroll<R> ([&] (auto i)
+      {
+        Unroll<C> ([&] (auto j)
+        {
+          T sum = T(0);
+          Unroll<K> ([&] (auto k) { sum += a(i,k) * b(k,j); });
+          res(i,j) = sum;
+        });
+      });
+    else
+      for (size_t i = 0; i < R; i++)
+        {
+          Vec<C,T> sum(T(0));
+          for (size_t k = 0; k < K; k++)
+            for (size_t j = 0; j < C; j++)
+              sum(j) += a(i,k) * b(k,j);
+          for (size_t j = 0; j < C; j++)
+            res(i,j) = sum(j);
+        }
+    return res;
+  }
+
+  template <size_t R, size_t C, typename T>
+  Vec<R,T> operator* (const Mat<R,C,T>& a, const Vec<C,T>& x)
+  {
+    Vec<R,T> res;
+    if constexpr (R*C <= MAT_UNROLL_LIMIT)
+      Unroll<R> ([&] (auto i)
+      {
+        T sum = T(0);
+        Unroll<C> ([&] (auto j) { sum += a(i,j) * x(j); });
+        res(i) = sum;
+      });
+    else
+      for (size_t i = 0; i < R; i++)
+        {
+          T sum = T(0);
+          for (size_t j = 0; j < C; j++)
+            sum += a(i,j) * x(j);
+          res(i) = sum;
+        }
+    return res;
+  }
+
+  // determinant: explicit formulas up to 3x3, elimination with partial pivoting beyond
+  template <size_t N, typename T>
+  T det (const Mat<N,N,T>& a)
+  {
+    if constexpr (N == 1)
+      return a(0,0);
+    else if constexpr (N == 2)
+      return a(0,0)*a(1,1) - a(0,1)*a(1,0);
+    else if constexpr (N == 3)
+      return a(0,0) * (a(1,1)*a(2,2) - a(1,2)*a(2,1))
+        - a(0,1) * (a(1,0)*a(2,2) - a(1,2)*a(2,0))
+        + a(0,2) * (a(1,0)*a(2,1) - a(1,1)*a(2,0));
+    else
+      {
+        Mat<N,N,T> lu = a;
+        T res = T(1);
+        for (size_t j = 0; j < N; j++)
+          {
+            size_t p = j;
+            for (size_t i = j+1; i < N; i++)
+              if (std::abs(lu(i,j)) > std::abs(lu(p,j)))
+                p = i;
+            if (lu(p,j) == T(0))
+              return T(0);
+            if (p != j)
+              {
+                for (size_t k = j; k < N; k++)
+                  std::swap (lu(j,k), lu(p,k));
+                res = -res;
+              }
+            res *= lu(j,j);
+            T inv = T(1) / lu(j,j);
+            for (size_t i = j+1; i < N; i++)
+              {
+                T f = lu(i,j) * inv;
+                for (size_t k = j+1; k < N; k++)
+                  lu(i,k) -= f * lu(j,k);
+              }
+          }
+        return res;
+      }
+  }
+
 }
 
 
@@ -0,0 +1,74 @@
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+#include "tuning.hpp"
+
+using namespace nanoblas;
+
+
+/*
+  Tunes the GEMM parameters of this host and writes them to its profile,
+  which is loaded by all following nanoblas programs (tuning.hpp).
+  Run it on every node type, with the number of threads used later
+  (NANOBLAS_NUM_THREADS), and the instruction set (NANOBLAS_ISA).
+
+  usage: nanoblas_tune [--quick] [--type double|float] [--file profile]
+*/
+
+
+template <typename T>
+bool Tune (bool quick, const std::string& file)
+{
+  std::cout << GemmProfileKey<T>() << ":" << std::endl;
+  auto res = TuneGemm<T> (quick, &std::cout);
+  auto & tile = Kernels<T>().gemm[res.par.tile];
+
+  std::ostringstream comment;
+  comment << std::setprecision(4) << res.gflops << " GFlop/s, " << GetNumThreads() << " threads";
+  std::cout << "best: tile " << tile.mr << "x" << tile.nr << ", mc " << res.par.mc
+            << ", kc " << res.par.kc << ", nc " << res.par.nc << ", " << comment.str() << std::endl;
+
+  if (!SaveGemmParams<T> (res.par, file, comment.str()))
+    {
+      std::cerr << "cannot write " << file << std::endl;
+      return false;
+    }
+  return true;
+}
+
+
+int main (int argc, char ** argv)
+{
+  bool quick = false;
+  std::string type = "all";
+  std::string file = GemmProfilePath();
+  for (int i = 1; i < argc; i++)
+    {
+      std::string arg = argv[i];
+      if (arg == "--quick") quick = true;
+      else if (arg == "--type" && i+1 < argc) type = argv[++i];
+      else if (arg == "--file" && i+1 < argc) file = argv[++i];
+      else
+        {
+          std::cerr << "usage: nanoblas_tune [--quick] [--type double|float] [--file profile]" << std::endl;
+          return 1;
+        }
+    }
+  if (type != "all" && type != "double" && type != "float")
+    {
+      std::cerr << "unknown type " << type << std::endl;
+      return 1;
+    }
+
+  std::cout << "host = " << HostName() << ", threads = " << GetNumThreads()
+            << ", ISA = " << ISAName(GetISA()) << std::endl;
+
+  bool ok = true;
+  if (type != "float") ok &= Tune<double> (quick, file);
+  if (type != "double") ok &= Tune<float> (quick, file);
+  if (!ok) return 1;
+
+  std::cout << "written to " << file << std::endl;
+}
@@ -0,0 +1,206 @@
+#ifndef FILE_PERFCOUNTERS
+#define FILE_PERFCOUNTERS
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <array>
+#include <atomic>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace nanoblas
+{
+
+  /*
+    Hardware performance counters by Linux perf_event_open
+
+    Every thread opens its own group of counters on first use. Counters
+    count user space only (allowed for perf_event_paranoid <= 2), events
+    not supported by the CPU or the kernel (e.g. in virtual machines)
+    are skipped and reported as unavailable.
+
+    There is no portable FP operation event. A raw event can be given
+    as hex config in NANOBLAS_PERF_FP_EVENT, e.g. 0x10c7 for scalar
+    double on Intel cores (FP_ARITH_INST_RETIRED.SCALAR_DOUBLE).
+
+    Counting is switched on by SetPerfCounting(true), the environment
+    variable NANOBLAS_PERF=1, or while a PerfScope is alive.
+
+    If the PMU cannot keep the group scheduled all the time (e.g. the NMI
+    watchdog holds a counter), the kernel multiplexes it: counts are then
+    scaled by time enabled / time running, and PerfMultiplexed() is set.
+    A group which never runs reports its events as unavailable.
+  */
+
+  enum PERF_EVENT
+    {
+      PERF_CYCLES, PERF_INSTRUCTIONS, PERF_L1D_MISSES, PERF_LLC_MISSES,
+      PERF_DTLB_MISSES, PERF_FP_OPS, PERF_PAGE_FAULTS, PERF_NUM_EVENTS
+    };
+
+  inline const char* PerfEventName (size_t e)
+  {
+    static const char* names[PERF_NUM_EVENTS] =
+      { "cycles", "instructions", "L1d_misses", "LLC_misses",
+        "dTLB_misses", "fp_ops", "page_faults" };
+    return names[e];
+  }
+
+  using PerfValues = std::array<uint64_t, PERF_NUM_EVENTS>;
+
+
+  // the counters of the calling thread
+  class PerfCounterGroup
+  {
+    int m_leader = -1;
+    std::array<int, PERF_NUM_EVENTS> m_fd;
+    std::array<int, PERF_NUM_EVENTS> m_slot;   // position in the group read, -1 if unavailable
+    int m_nopen = 0;
+    mutable bool m_running = true;               // false if the group could not be scheduled
+
+#ifdef __linux__
+    static bool Config (size_t e, perf_event_attr & attr)
+    {
+      auto cache = [] (uint64_t id) { return id | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                                         | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16); };
+      auto & type = attr.type;
+      auto & config = attr.config;
+      switch (e)
+        {
+        case PERF_CYCLES: type = PERF_TYPE_HARDWARE; config = PERF_COUNT_HW_CPU_CYCLES; return true;
+        case PERF_INSTRUCTIONS: type = PERF_TYPE_HARDWARE; config = PERF_COUNT_HW_INSTRUCTIONS; return true;
+        case PERF_L1D_MISSES: type = PERF_TYPE_HW_CACHE; config = cache(PERF_COUNT_HW_CACHE_L1D); return true;
+        case PERF_LLC_MISSES: type = PERF_TYPE_HARDWARE; config = PERF_COUNT_HW_CACHE_MISSES; return true;
+        case PERF_DTLB_MISSES: type = PERF_TYPE_HW_CACHE; config = cache(PERF_COUNT_HW_CACHE_DTLB); return true;
+        case PERF_FP_OPS:
+          if (const char* env = std::getenv("NANOBLAS_PERF_FP_EVENT"))
+            {
+              type = PERF_TYPE_RAW;
+              config = std::strtoull(env, nullptr, 16);
+              return config != 0;
+            }
+          return false;
+        case PERF_PAGE_FAULTS: type = PERF_TYPE_SOFTWARE; config = PERF_COUNT_SW_PAGE_FAULTS; return true;
+        }
+      return false;
+    }
+#endif
+
+  public:
+    PerfCounterGroup ()
+    {
+      m_fd.fill(-1);
+      m_slot.fill(-1);
+#ifdef __linux__
+      for (size_t e = 0; e < PERF_NUM_EVENTS; e++)
+        {
+          perf_event_attr attr;
+          std::memset (&attr, 0, sizeof(attr));
+          attr.size = sizeof(attr);
+          if (!Config (e, attr)) continue;
+          attr.exclude_kernel = 1;
+          attr.exclude_hv = 1;
+          attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED
+            | PERF_FORMAT_TOTAL_TIME_RUNNING;
+          int fd = syscall (SYS_perf_event_open, &attr, 0, -1, m_leader, 0);
+          if (fd < 0) continue;
+          if (m_leader < 0) m_leader = fd;
+          m_fd[e] = fd;
+          m_slot[e] = m_nopen++;
+        }
+#endif
+    }
+
+    ~PerfCounterGroup ()
+    {
+#ifdef __linux__
+      // members first, the leader last
+      for (int fd : m_fd)
+        if (fd >= 0 && fd != m_leader) close (fd);
+      if (m_leader >= 0) close (m_leader);
+#endif
+    }
+
+    PerfCounterGroup (const PerfCounterGroup&) = delete;
+
+    static PerfCounterGroup& ThreadLocal()
+    {
+      thread_local PerfCounterGroup group;
+      return group;
+    }
+
+    bool Available (size_t e) const { return m_slot[e] >= 0 && m_running; }
+
+    // current counts, zero for unavailable events, scaled if the group was multiplexed
+    PerfValues Read () const;
+  };
+
+
+  // counting is active if switched on, or while scopes are open
+  class PerfCounting
+  {
+    static inline std::atomic<bool> s_enabled { [] ()
+    {
+      const char* env = std::getenv("NANOBLAS_PERF");
+      return env && std::atoi(env) > 0;
+    } () };
+    static inline std::atomic<int> s_scopes{0};
+  public:
+    static bool Active()
+    {
+      return s_enabled.load(std::memory_order_relaxed) || s_scopes.load(std::memory_order_relaxed) > 0;
+    }
+    static void Enable (bool on) { s_enabled = on; }
+    static void OpenScope () { s_scopes++; }
+    static void CloseScope () { s_scopes--; }
+
+    // some group was not scheduled all the time, its counts are estimates
+    static inline std::atomic<bool> s_multiplexed{false};
+  };
+
+
+  inline PerfValues PerfCounterGroup::Read () const
+  {
+    PerfValues vals{};
+#ifdef __linux__
+    if (m_leader < 0 || !m_running) return vals;
+
+    // nr, time enabled, time running, values
+    uint64_t buf[3+PERF_NUM_EVENTS];
+    if (read (m_leader, buf, sizeof(buf)) < ssize_t(3*sizeof(uint64_t))) return vals;
+    uint64_t enabled = buf[1], running = buf[2];
+    if (running == 0)
+      {
+        if (enabled > 0) m_running = false;   // never got the PMU
+        return vals;
+      }
+    double scale = 1;
+    if (running < enabled)
+      {
+        scale = double(enabled) / double(running);
+        PerfCounting::s_multiplexed.store(true, std::memory_order_relaxed);
+      }
+    for (size_t e = 0; e < PERF_NUM_EVENTS; e++)
+      if (m_slot[e] >= 0 && uint64_t(m_slot[e]) < buf[0])
+        vals[e] = (scale == 1) ? buf[3+m_slot[e]] : uint64_t(scale * double(buf[3+m_slot[e]]));
+#endif
+    return vals;
+  }
+
+  inline void SetPerfCounting (bool on) { PerfCounting::Enable(on); }
+
+  // events supported on the calling thread
+  inline bool PerfEventAvailable (size_t e) { return PerfCounterGroup::ThreadLocal().Available(e); }
+
+  // counts were scaled because counters were multiplexed
+  inline bool PerfMultiplexed () { return PerfCounting::s_multiplexed.load(); }
+
+}
+
+#endif
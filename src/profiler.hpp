@@ -0,0 +1,301 @@
+#ifndef FILE_PROFILER
+#define FILE_PROFILER
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <iomanip>
+#include <optional>
+
+#include "perfcounters.hpp"
+
+namespace nanoblas
+{
+
+  /*
+    Kernel instrumentation, compiled in if NANOBLAS_PROFILE is defined
+
+    Every instrumented kernel counts calls, wall time, floating point
+    operations and bytes moved (operands read once, results written
+    once, a lower bound for the memory traffic). Times are inclusive:
+    LU contains the time of the GEMMs it calls, which are listed under
+    gemm as well.
+
+      NANOBLAS_PROFILE_KERNEL(name, flops, bytes)   at the top of a kernel
+      GetProfile()                                  snapshot of all counters
+      PrintProfile(ost)                             table with GFlop/s and GB/s
+      ResetProfile()
+
+    Without NANOBLAS_PROFILE the macro expands to nothing, the flop and
+    byte expressions are not evaluated, and GetProfile() is empty.
+
+    While hardware counting is active (perfcounters.hpp), kernels also
+    add up their perf counter deltas. Tasks of a parallel loop executed
+    by other threads are attributed to the kernel which started the loop.
+    PerfScope(name) is a user region with the same counters, it turns
+    counting on while it is alive (also without NANOBLAS_PROFILE, then
+    scopes are the only entries of the profile).
+  */
+
+  struct ProfileEntry
+  {
+    std::string name;
+    size_t calls;
+    double time;       // seconds
+    double flops;
+    double bytes;
+    std::array<double, PERF_NUM_EVENTS> perf{};   // hardware counters
+
+    double GFlops() const { return (time > 0) ? flops / time * 1e-9 : 0; }
+    double GBytes() const { return (time > 0) ? bytes / time * 1e-9 : 0; }
+  };
+
+
+  class Profiler
+  {
+  public:
+    struct Counter
+    {
+      std::string name;
+      std::atomic<uint64_t> calls{0}, nanosec{0}, flops{0}, bytes{0};
+      std::array<std::atomic<uint64_t>, PERF_NUM_EVENTS> perf{};
+      Counter (std::string _name) : name(std::move(_name)) { }
+
+      // adds the counts of the calling thread since start
+      void AddPerf (const PerfValues& start)
+      {
+        PerfValues now = PerfCounterGroup::ThreadLocal().Read();
+        for (size_t e = 0; e < PERF_NUM_EVENTS; e++)
+          perf[e].fetch_add(now[e]-start[e], std::memory_order_relaxed);
+      }
+    };
+
+  private:
+    std::mutex m_mutex;
+    std::deque<Counter> m_counters;   // deque keeps the addresses stable
+    static inline thread_local Counter* t_current = nullptr;
+
+  public:
+    static Profiler& Instance()
+    {
+      static Profiler prof;
+      return prof;
+    }
+
+    // the counter of a kernel, call sites with the same name share it
+    Counter& Get (const char* name)
+    {
+      std::lock_guard<std::mutex> guard(m_mutex);
+      for (auto & c : m_counters)
+        if (c.name == name) return c;
+      return m_counters.emplace_back(name);
+    }
+
+    // the innermost region running on this thread
+    static Counter*& Current() { return t_current; }
+
+    std::vector<ProfileEntry> Table()
+    {
+      std::lock_guard<std::mutex> guard(m_mutex);
+      std::vector<ProfileEntry> table;
+      for (auto & c : m_counters)
+        {
+          ProfileEntry entry { c.name, size_t(c.calls.load()), c.nanosec.load()*1e-9,
+                               double(c.flops.load()), double(c.bytes.load()) };
+          for (size_t e = 0; e < PERF_NUM_EVENTS; e++)
+            entry.perf[e] = double(c.perf[e].load());
+          table.push_back (entry);
+        }
+      return table;
+    }
+
+    void Reset()
+    {
+      std::lock_guard<std::mutex> guard(m_mutex);
+      for (auto & c : m_counters)
+        {
+          c.calls = c.nanosec = c.flops = c.bytes = 0;
+          for (auto & p : c.perf) p = 0;
+        }
+    }
+  };
+
+
+  // counts one call of a kernel, the time (and hardware counters) until destruction
+  class ProfileRegion
+  {
+    Profiler::Counter& m_counter;
+    Profiler::Counter* m_outer;
+    std::optional<PerfValues> m_perf;
+    std::chrono::steady_clock::time_point m_start;
+  public:
+    ProfileRegion (Profiler::Counter& counter, double flops, double bytes)
+      : m_counter(counter), m_outer(Profiler::Current())
+    {
+      m_counter.calls.fetch_add(1, std::memory_order_relaxed);
+      m_counter.flops.fetch_add(uint64_t(flops), std::memory_order_relaxed);
+      m_counter.bytes.fetch_add(uint64_t(bytes), std::memory_order_relaxed);
+      Profiler::Current() = &m_counter;
+      if (PerfCounting::Active())
+        m_perf = PerfCounterGroup::ThreadLocal().Read();
+      m_start = std::chrono::steady_clock::now();
+    }
+    ProfileRegion (const ProfileRegion&) = delete;
+
+    ~ProfileRegion()
+    {
+      auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>
+        (std::chrono::steady_clock::now() - m_start).count();
+      m_counter.nanosec.fetch_add(uint64_t(ns), std::memory_order_relaxed);
+      if (m_perf) m_counter.AddPerf (*m_perf);
+      Profiler::Current() = m_outer;
+    }
+  };
+
+
+  // hardware counters of a parallel task run by another thread, for the region of the caller
+  class PerfTaskRegion
+  {
+    Profiler::Counter& m_counter;
+    PerfValues m_start;
+  public:
+    PerfTaskRegion (Profiler::Counter& counter)
+      : m_counter(counter), m_start(PerfCounterGroup::ThreadLocal().Read()) { }
+    PerfTaskRegion (const PerfTaskRegion&) = delete;
+    ~PerfTaskRegion() { m_counter.AddPerf (m_start); }
+  };
+
+
+  /*
+    User region: counts calls, time and hardware counters of the code
+    inside (including the parallel tasks it starts), listed under name
+    in the profile. Counting is active while the scope is running.
+    Counts() are the counts of this scope between Start and Stop.
+  */
+  class PerfScope
+  {
+    Profiler::Counter& m_counter;
+    std::optional<ProfileRegion> m_region;
+    ProfileEntry m_before, m_counts;
+
+    ProfileEntry Snapshot() const
+    {
+      ProfileEntry entry { m_counter.name, size_t(m_counter.calls.load()), m_counter.nanosec.load()*1e-9, 0, 0 };
+      for (size_t e = 0; e < PERF_NUM_EVENTS; e++)
+        entry.perf[e] = double(m_counter.perf[e].load());
+      return entry;
+    }
+
+  public:
+    PerfScope (const std::string& name, bool start = true)
+      : m_counter(Profiler::Instance().Get(name.c_str()))
+    {
+      m_counts = Snapshot();
+      if (start) Start();
+    }
+    PerfScope (const PerfScope&) = delete;
+    ~PerfScope() { Stop(); }
+
+    void Start()
+    {
+      if (m_region) return;
+      PerfCounting::OpenScope();
+      m_before = Snapshot();
+      m_region.emplace (m_counter, 0, 0);
+    }
+
+    void Stop()
+    {
+      if (!m_region) return;
+      m_region.reset();
+      PerfCounting::CloseScope();
+      ProfileEntry after = Snapshot();
+      m_counts.calls = after.calls - m_before.calls;
+      m_counts.time = after.time - m_before.time;
+      for (size_t e = 0; e < PERF_NUM_EVENTS; e++)
+        m_counts.perf[e] = after.perf[e] - m_before.perf[e];
+    }
+
+    const ProfileEntry& Counts() const { return m_counts; }
+  };
+
+
+#define NANOBLAS_CONCAT_(a,b) a##b
+#define NANOBLAS_CONCAT(a,b) NANOBLAS_CONCAT_(a,b)
+
+#ifdef NANOBLAS_PROFILE
+#define NANOBLAS_PROFILE_KERNEL(name, flops, bytes)                     \
+  static ::nanoblas::Profiler::Counter& NANOBLAS_CONCAT(nanoblas_counter_, __LINE__) = \
+    ::nanoblas::Profiler::Instance().Get(name);                         \
+  ::nanoblas::ProfileRegion NANOBLAS_CONCAT(nanoblas_region_, __LINE__) \
+    (NANOBLAS_CONCAT(nanoblas_counter_, __LINE__), double(flops), double(bytes))
+#else
+#define NANOBLAS_PROFILE_KERNEL(name, flops, bytes) do { } while (0)
+#endif
+
+
+  constexpr bool ProfilingEnabled()
+  {
+#ifdef NANOBLAS_PROFILE
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  inline std::vector<ProfileEntry> GetProfile() { return Profiler::Instance().Table(); }
+
+  inline void ResetProfile()
+  {
+    Profiler::Instance().Reset();
+    PerfCounting::s_multiplexed = false;
+  }
+
+  // the table, and a table of hardware counters if there are counts
+  inline void PrintProfile (std::ostream & ost)
+  {
+    auto table = GetProfile();
+    ost << std::left << std::setw(24) << "kernel" << std::right
+        << std::setw(10) << "calls" << std::setw(12) << "time[s]"
+        << std::setw(12) << "GFlop/s" << std::setw(12) << "GB/s" << "\n";
+    for (auto & e : table)
+      ost << std::left << std::setw(24) << e.name << std::right
+          << std::setw(10) << e.calls << std::setw(12) << std::setprecision(4) << e.time
+          << std::setw(12) << e.GFlops() << std::setw(12) << e.GBytes() << "\n";
+
+    bool counted = false;
+    for (auto & e : table)
+      for (double p : e.perf)
+        counted |= (p > 0);
+    if (!counted) return;
+
+    ost << "\n" << std::left << std::setw(24) << "kernel" << std::right;
+    for (size_t p = 0; p < PERF_NUM_EVENTS; p++)
+      ost << std::setw(14) << PerfEventName(p);
+    ost << std::setw(8) << "IPC" << "\n";
+    for (auto & e : table)
+      {
+        ost << std::left << std::setw(24) << e.name << std::right << std::setprecision(4);
+        for (size_t p = 0; p < PERF_NUM_EVENTS; p++)
+          if (PerfEventAvailable(p))
+            ost << std::setw(14) << e.perf[p];
+          else
+            ost << std::setw(14) << "-";
+        if (e.perf[PERF_CYCLES] > 0)
+          ost << std::setw(8) << std::setprecision(3) << e.perf[PERF_INSTRUCTIONS] / e.perf[PERF_CYCLES];
+        ost << "\n";
+      }
+    if (PerfMultiplexed())
+      ost << "(counters were multiplexed, counts are scaled estimates)\n";
+  }
+
+}
+
+#endif
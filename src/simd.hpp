@@ -0,0 +1,587 @@
+#ifndef FILE_SIMD
+#define FILE_SIMD
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <complex>
+#include <algorithm>
+#include <type_traits>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/*
+  Everything compiled for a specific instruction set is declared in the
+  inline namespace NANOBLAS_ISA. Translation units compiled with other
+  flags (the kernels of the dispatch library, see kernels.hpp) get
+  symbols of their own for this code. Functions of the standard library
+  do not: unless inlined (e.g. in debug builds) they are emitted as weak
+  symbols, and the linker keeps one copy for the whole program, compiled
+  for any of the instruction sets. Code in NANOBLAS_ISA therefore calls
+  the helpers Min, Abs and Swap below instead of std::min, std::abs and
+  std::swap.
+*/
+#ifndef NANOBLAS_ISA
+#if defined(__AVX512F__)
+#define NANOBLAS_ISA isa_avx512
+#elif defined(__AVX2__)
+#define NANOBLAS_ISA isa_avx2
+#elif defined(__SSE2__)
+#define NANOBLAS_ISA isa_sse2
+#else
+#define NANOBLAS_ISA isa_generic
+#endif
+#endif
+
+namespace nanoblas
+{
+inline namespace NANOBLAS_ISA
+{
+
+  /*
+    SIMD<T,N>: N values of type T, kept in vector registers
+
+    The generic class stores an array and works for any T and N, it serves
+    as scalar fallback. Specializations map to SSE2, AVX2 and AVX-512
+    registers for double and float. SIMD<complex<double>,N> is stored
+    interleaved (re,im,re,im,...) in a SIMD<double,2N>.
+
+      SIMD<T,N> (T val)               broadcast
+      SIMD<T,N> (const T* p)          load N values (unaligned)
+      SIMD<T,N> (const T* p, size_t n) load first n values, rest is zero
+      Store (T* p), Store (T* p, n)   the counterparts
+      FMA(a,b,c) = a*b+c, HSum(a) = sum of all entries
+      Transpose (SIMD<T,N> (&a)[N])  transpose the N x N block a[row][col]
+  */
+
+
+  // register width in bytes of the instruction set we compile for
+#if defined(__AVX512F__)
+  constexpr size_t SIMD_BYTES = 64;
+#elif defined(__AVX2__)
+  constexpr size_t SIMD_BYTES = 32;
+#else
+  constexpr size_t SIMD_BYTES = 16;
+#endif
+
+  // instead of std::min, std::abs, std::swap, see above
+  template <typename T>
+  inline T Min (T a, T b) { return (b < a) ? b : a; }
+
+  template <typename T>
+  inline T Abs (T x)
+  {
+    static_assert (std::is_arithmetic_v<T>, "Abs is for real numbers");
+    return (x < T(0)) ? -x : x;
+  }
+
+  template <typename T>
+  inline void Swap (T & a, T & b)
+  {
+    T h = a;
+    a = b;
+    b = h;
+  }
+
+  // number of T's filling one register
+  template <typename T>
+  constexpr size_t SimdWidth() { return (SIMD_BYTES > sizeof(T)) ? SIMD_BYTES / sizeof(T) : 1; }
+
+
+
+  // ********************** generic SIMD *********************
+
+  template <typename T, size_t N>
+  class SIMD
+  {
+    std::array<T,N> m_val;
+  public:
+    static constexpr size_t Size() { return N; }
+    SIMD () = default;
+    SIMD (T val) { m_val.fill(val); }
+    SIMD (const T* p) { for (size_t i = 0; i < N; i++) m_val[i] = p[i]; }
+    SIMD (const T* p, size_t n) { for (size_t i = 0; i < N; i++) m_val[i] = (i < n) ? p[i] : T(0); }
+
+    void Store (T* p) const { for (size_t i = 0; i < N; i++) p[i] = m_val[i]; }
+    void Store (T* p, size_t n) const { for (size_t i = 0; i < Min(n,N); i++) p[i] = m_val[i]; }
+
+    T operator[] (size_t i) const { return m_val[i]; }
+    T& operator[] (size_t i) { return m_val[i]; }
+  };
+
+  template <typename T, size_t N>
+  auto operator+ (SIMD<T,N> a, SIMD<T,N> b)
+  { SIMD<T,N> res; for (size_t i = 0; i < N; i++) res[i] = a[i]+b[i]; return res; }
+
+  template <typename T, size_t N>
+  auto operator- (SIMD<T,N> a, SIMD<T,N> b)
+  { SIMD<T,N> res; for (size_t i = 0; i < N; i++) res[i] = a[i]-b[i]; return res; }
+
+  template <typename T, size_t N>
+  auto operator* (SIMD<T,N> a, SIMD<T,N> b)
+  { SIMD<T,N> res; for (size_t i = 0; i < N; i++) res[i] = a[i]*b[i]; return res; }
+
+  template <typename T, size_t N>
+  auto operator- (SIMD<T,N> a)
+  { SIMD<T,N> res; for (size_t i = 0; i < N; i++) res[i] = -a[i]; return res; }
+
+  template <typename T, size_t N>
+  auto FMA (SIMD<T,N> a, SIMD<T,N> b, SIMD<T,N> c)
+  { SIMD<T,N> res; for (size_t i = 0; i < N; i++) res[i] = a[i]*b[i]+c[i]; return res; }
+
+  template <typename T, size_t N>
+  T HSum (SIMD<T,N> a)
+  { T sum = a[0]; for (size_t i = 1; i < N; i++) sum += a[i]; return sum; }
+
+  // (x0,x1,x2,x3,..) -> (x0,x0,x2,x2,..), (x1,x1,x3,x3,..), (x1,x0,x3,x2,..)
+  template <typename T, size_t N>
+  auto DupEven (SIMD<T,N> a)
+  { SIMD<T,N> res; for (size_t i = 0; i < N; i++) res[i] = a[i & ~size_t(1)]; return res; }
+
+  template <typename T, size_t N>
+  auto DupOdd (SIMD<T,N> a)
+  { SIMD<T,N> res; for (size_t i = 0; i < N; i++) res[i] = a[i | 1]; return res; }
+
+  template <typename T, size_t N>
+  auto SwapPairs (SIMD<T,N> a)
+  { SIMD<T,N> res; for (size_t i = 0; i < N; i++) res[i] = a[i ^ 1]; return res; }
+
+  // through memory, overloads for registers below
+  template <typename T, size_t N>
+  void Transpose (SIMD<T,N> (&a)[N])
+  {
+    T tmp[N][N], col[N];
+    for (size_t i = 0; i < N; i++)
+      a[i].Store(tmp[i]);
+    for (size_t j = 0; j < N; j++)
+      {
+        for (size_t i = 0; i < N; i++)
+          col[i] = tmp[i][j];
+        a[j] = SIMD<T,N>(col);
+      }
+  }
+
+  template <typename T, size_t N>
+  auto& operator+= (SIMD<T,N>& a, SIMD<T,N> b) { return a = a+b; }
+
+  template <typename T, size_t N>
+  auto& operator-= (SIMD<T,N>& a, SIMD<T,N> b) { return a = a-b; }
+
+  template <typename T, size_t N>
+  auto& operator*= (SIMD<T,N>& a, SIMD<T,N> b) { return a = a*b; }
+
+
+
+  // ********************** SSE2 *********************
+
+#if defined(__SSE2__)
+
+  template<>
+  class SIMD<double,2>
+  {
+    __m128d m_val;
+  public:
+    static constexpr size_t Size() { return 2; }
+    SIMD () = default;
+    SIMD (__m128d val) : m_val(val) { }
+    SIMD (double val) : m_val(_mm_set1_pd(val)) { }
+    SIMD (const double* p) : m_val(_mm_loadu_pd(p)) { }
+    SIMD (const double* p, size_t n)
+      : m_val( (n >= 2) ? _mm_loadu_pd(p) : (n == 1) ? _mm_load_sd(p) : _mm_setzero_pd()) { }
+
+    void Store (double* p) const { _mm_storeu_pd(p, m_val); }
+    void Store (double* p, size_t n) const
+    {
+      if (n >= 2) _mm_storeu_pd(p, m_val);
+      else if (n == 1) _mm_store_sd(p, m_val);
+    }
+
+    __m128d Val() const { return m_val; }
+    double operator[] (size_t i) const { alignas(16) double v[2]; _mm_store_pd(v, m_val); return v[i]; }
+  };
+
+  inline SIMD<double,2> operator+ (SIMD<double,2> a, SIMD<double,2> b) { return _mm_add_pd(a.Val(), b.Val()); }
+  inline SIMD<double,2> operator- (SIMD<double,2> a, SIMD<double,2> b) { return _mm_sub_pd(a.Val(), b.Val()); }
+  inline SIMD<double,2> operator* (SIMD<double,2> a, SIMD<double,2> b) { return _mm_mul_pd(a.Val(), b.Val()); }
+  inline SIMD<double,2> operator- (SIMD<double,2> a) { return _mm_xor_pd(a.Val(), _mm_set1_pd(-0.0)); }
+#if defined(__FMA__)
+  inline SIMD<double,2> FMA (SIMD<double,2> a, SIMD<double,2> b, SIMD<double,2> c)
+  { return _mm_fmadd_pd(a.Val(), b.Val(), c.Val()); }
+#else
+  inline SIMD<double,2> FMA (SIMD<double,2> a, SIMD<double,2> b, SIMD<double,2> c) { return a*b+c; }
+#endif
+  inline double HSum (SIMD<double,2> a)
+  { return _mm_cvtsd_f64(_mm_add_sd(a.Val(), _mm_unpackhi_pd(a.Val(), a.Val()))); }
+  inline SIMD<double,2> DupEven (SIMD<double,2> a) { return _mm_unpacklo_pd(a.Val(), a.Val()); }
+  inline SIMD<double,2> DupOdd (SIMD<double,2> a) { return _mm_unpackhi_pd(a.Val(), a.Val()); }
+  inline SIMD<double,2> SwapPairs (SIMD<double,2> a) { return _mm_shuffle_pd(a.Val(), a.Val(), 1); }
+
+  inline void Transpose (SIMD<double,2> (&a)[2])
+  {
+    __m128d lo = _mm_unpacklo_pd(a[0].Val(), a[1].Val());
+    __m128d hi = _mm_unpackhi_pd(a[0].Val(), a[1].Val());
+    a[0] = lo; a[1] = hi;
+  }
+
+
+  template<>
+  class SIMD<float,4>
+  {
+    __m128 m_val;
+  public:
+    static constexpr size_t Size() { return 4; }
+    SIMD () = default;
+    SIMD (__m128 val) : m_val(val) { }
+    SIMD (float val) : m_val(_mm_set1_ps(val)) { }
+    SIMD (const float* p) : m_val(_mm_loadu_ps(p)) { }
+    SIMD (const float* p, size_t n)
+    {
+      if (n >= 4) { m_val = _mm_loadu_ps(p); return; }
+      alignas(16) float v[4] = { 0, 0, 0, 0 };
+      for (size_t i = 0; i < n; i++) v[i] = p[i];
+      m_val = _mm_load_ps(v);
+    }
+
+    void Store (float* p) const { _mm_storeu_ps(p, m_val); }
+    void Store (float* p, size_t n) const
+    {
+      if (n >= 4) { _mm_storeu_ps(p, m_val); return; }
+      alignas(16) float v[4];
+      _mm_store_ps(v, m_val);
+      for (size_t i = 0; i < n; i++) p[i] = v[i];
+    }
+
+    __m128 Val() const { return m_val; }
+    float operator[] (size_t i) const { alignas(16) float v[4]; _mm_store_ps(v, m_val); return v[i]; }
+  };
+
+  inline SIMD<float,4> operator+ (SIMD<float,4> a, SIMD<float,4> b) { return _mm_add_ps(a.Val(), b.Val()); }
+  inline SIMD<float,4> operator- (SIMD<float,4> a, SIMD<float,4> b) { return _mm_sub_ps(a.Val(), b.Val()); }
+  inline SIMD<float,4> operator* (SIMD<float,4> a, SIMD<float,4> b) { return _mm_mul_ps(a.Val(), b.Val()); }
+  inline SIMD<float,4> operator- (SIMD<float,4> a) { return _mm_xor_ps(a.Val(), _mm_set1_ps(-0.0f)); }
+#if defined(__FMA__)
+  inline SIMD<float,4> FMA (SIMD<float,4> a, SIMD<float,4> b, SIMD<float,4> c)
+  { return _mm_fmadd_ps(a.Val(), b.Val(), c.Val()); }
+#else
+  inline SIMD<float,4> FMA (SIMD<float,4> a, SIMD<float,4> b, SIMD<float,4> c) { return a*b+c; }
+#endif
+  inline float HSum (SIMD<float,4> a)
+  {
+    __m128 s = _mm_add_ps(a.Val(), _mm_movehl_ps(a.Val(), a.Val()));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+  }
+  inline void Transpose (SIMD<float,4> (&a)[4])
+  {
+    __m128 r0 = a[0].Val(), r1 = a[1].Val(), r2 = a[2].Val(), r3 = a[3].Val();
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    a[0] = r0; a[1] = r1; a[2] = r2; a[3] = r3;
+  }
+
+#endif
+
+
+
+  // ********************** AVX2 *********************
+
+#if defined(__AVX2__)
+
+  template<>
+  class SIMD<double,4>
+  {
+    __m256d m_val;
+    static __m256i Mask (size_t n)
+    { return _mm256_cmpgt_epi64(_mm256_set1_epi64x(n), _mm256_set_epi64x(3,2,1,0)); }
+  public:
+    static constexpr size_t Size() { return 4; }
+    SIMD () = default;
+    SIMD (__m256d val) : m_val(val) { }
+    SIMD (double val) : m_val(_mm256_set1_pd(val)) { }
+    SIMD (const double* p) : m_val(_mm256_loadu_pd(p)) { }
+    SIMD (const double* p, size_t n)
+      : m_val( (n >= 4) ? _mm256_loadu_pd(p) : _mm256_maskload_pd(p, Mask(n))) { }
+
+    void Store (double* p) const { _mm256_storeu_pd(p, m_val); }
+    void Store (double* p, size_t n) const
+    {
+      if (n >= 4) _mm256_storeu_pd(p, m_val);
+      else _mm256_maskstore_pd(p, Mask(n), m_val);
+    }
+
+    __m256d Val() const { return m_val; }
+    double operator[] (size_t i) const { alignas(32) double v[4]; _mm256_store_pd(v, m_val); return v[i]; }
+  };
+
+  inline SIMD<double,4> operator+ (SIMD<double,4> a, SIMD<double,4> b) { return _mm256_add_pd(a.Val(), b.Val()); }
+  inline SIMD<double,4> operator- (SIMD<double,4> a, SIMD<double,4> b) { return _mm256_sub_pd(a.Val(), b.Val()); }
+  inline SIMD<double,4> operator* (SIMD<double,4> a, SIMD<double,4> b) { return _mm256_mul_pd(a.Val(), b.Val()); }
+  inline SIMD<double,4> operator- (SIMD<double,4> a) { return _mm256_xor_pd(a.Val(), _mm256_set1_pd(-0.0)); }
+#if defined(__FMA__)
+  inline SIMD<double,4> FMA (SIMD<double,4> a, SIMD<double,4> b, SIMD<double,4> c)
+  { return _mm256_fmadd_pd(a.Val(), b.Val(), c.Val()); }
+#else
+  inline SIMD<double,4> FMA (SIMD<double,4> a, SIMD<double,4> b, SIMD<double,4> c) { return a*b+c; }
+#endif
+  inline double HSum (SIMD<double,4> a)
+  {
+    __m128d s = _mm_add_pd(_mm256_castpd256_pd128(a.Val()), _mm256_extractf128_pd(a.Val(), 1));
+    return HSum(SIMD<double,2>(s));
+  }
+  inline SIMD<double,4> DupEven (SIMD<double,4> a) { return _mm256_movedup_pd(a.Val()); }
+  inline SIMD<double,4> DupOdd (SIMD<double,4> a) { return _mm256_permute_pd(a.Val(), 0xF); }
+  inline SIMD<double,4> SwapPairs (SIMD<double,4> a) { return _mm256_permute_pd(a.Val(), 0x5); }
+
+  // pairs of rows interleaved, then 128-bit halves exchanged
+  inline void Transpose (SIMD<double,4> (&a)[4])
+  {
+    __m256d t0 = _mm256_unpacklo_pd(a[0].Val(), a[1].Val());
+    __m256d t1 = _mm256_unpackhi_pd(a[0].Val(), a[1].Val());
+    __m256d t2 = _mm256_unpacklo_pd(a[2].Val(), a[3].Val());
+    __m256d t3 = _mm256_unpackhi_pd(a[2].Val(), a[3].Val());
+    a[0] = _mm256_permute2f128_pd(t0, t2, 0x20);
+    a[1] = _mm256_permute2f128_pd(t1, t3, 0x20);
+    a[2] = _mm256_permute2f128_pd(t0, t2, 0x31);
+    a[3] = _mm256_permute2f128_pd(t1, t3, 0x31);
+  }
+
+
+  template<>
+  class SIMD<float,8>
+  {
+    __m256 m_val;
+    static __m256i Mask (size_t n)
+    { return _mm256_cmpgt_epi32(_mm256_set1_epi32(n), _mm256_set_epi32(7,6,5,4,3,2,1,0)); }
+  public:
+    static constexpr size_t Size() { return 8; }
+    SIMD () = default;
+    SIMD (__m256 val) : m_val(val) { }
+    SIMD (float val) : m_val(_mm256_set1_ps(val)) { }
+    SIMD (const float* p) : m_val(_mm256_loadu_ps(p)) { }
+    SIMD (const float* p, size_t n)
+      : m_val( (n >= 8) ? _mm256_loadu_ps(p) : _mm256_maskload_ps(p, Mask(n))) { }
+
+    void Store (float* p) const { _mm256_storeu_ps(p, m_val); }
+    void Store (float* p, size_t n) const
+    {
+      if (n >= 8) _mm256_storeu_ps(p, m_val);
+      else _mm256_maskstore_ps(p, Mask(n), m_val);
+    }
+
+    __m256 Val() const { return m_val; }
+    float operator[] (size_t i) const { alignas(32) float v[8]; _mm256_store_ps(v, m_val); return v[i]; }
+  };
+
+  inline SIMD<float,8> operator+ (SIMD<float,8> a, SIMD<float,8> b) { return _mm256_add_ps(a.Val(), b.Val()); }
+  inline SIMD<float,8> operator- (SIMD<float,8> a, SIMD<float,8> b) { return _mm256_sub_ps(a.Val(), b.Val()); }
+  inline SIMD<float,8> operator* (SIMD<float,8> a, SIMD<float,8> b) { return _mm256_mul_ps(a.Val(), b.Val()); }
+  inline SIMD<float,8> operator- (SIMD<float,8> a) { return _mm256_xor_ps(a.Val(), _mm256_set1_ps(-0.0f)); }
+#if defined(__FMA__)
+  inline SIMD<float,8> FMA (SIMD<float,8> a, SIMD<float,8> b, SIMD<float,8> c)
+  { return _mm256_fmadd_ps(a.Val(), b.Val(), c.Val()); }
+#else
+  inline SIMD<float,8> FMA (SIMD<float,8> a, SIMD<float,8> b, SIMD<float,8> c) { return a*b+c; }
+#endif
+  inline float HSum (SIMD<float,8> a)
+  {
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(a.Val()), _mm256_extractf128_ps(a.Val(), 1));
+    return HSum(SIMD<float,4>(s));
+  }
+
+#endif
+
+
+
+  // ********************** AVX-512 *********************
+
+#if defined(__AVX512F__)
+
+  template<>
+  class SIMD<double,8>
+  {
+    __m512d m_val;
+    static __mmask8 Mask (size_t n) { return __mmask8((1u << n) - 1); }
+  public:
+    static constexpr size_t Size() { return 8; }
+    SIMD () = default;
+    SIMD (__m512d val) : m_val(val) { }
+    SIMD (double val) : m_val(_mm512_set1_pd(val)) { }
+    SIMD (const double* p) : m_val(_mm512_loadu_pd(p)) { }
+    SIMD (const double* p, size_t n)
+      : m_val( (n >= 8) ? _mm512_loadu_pd(p) : _mm512_maskz_loadu_pd(Mask(n), p)) { }
+
+    void Store (double* p) const { _mm512_storeu_pd(p, m_val); }
+    void Store (double* p, size_t n) const
+    {
+      if (n >= 8) _mm512_storeu_pd(p, m_val);
+      else _mm512_mask_storeu_pd(p, Mask(n), m_val);
+    }
+
+    __m512d Val() const { return m_val; }
+    double operator[] (size_t i) const { alignas(64) double v[8]; _mm512_store_pd(v, m_val); return v[i]; }
+  };
+
+  inline SIMD<double,8> operator+ (SIMD<double,8> a, SIMD<double,8> b) { return _mm512_add_pd(a.Val(), b.Val()); }
+  inline SIMD<double,8> operator- (SIMD<double,8> a, SIMD<double,8> b) { return _mm512_sub_pd(a.Val(), b.Val()); }
+  inline SIMD<double,8> operator* (SIMD<double,8> a, SIMD<double,8> b) { return _mm512_mul_pd(a.Val(), b.Val()); }
+  inline SIMD<double,8> operator- (SIMD<double,8> a) { return _mm512_sub_pd(_mm512_setzero_pd(), a.Val()); }
+  inline SIMD<double,8> FMA (SIMD<double,8> a, SIMD<double,8> b, SIMD<double,8> c)
+  { return _mm512_fmadd_pd(a.Val(), b.Val(), c.Val()); }
+  // halves by zero-masked extracts, GCC warns about the undefined pass-through of the unmasked ones
+  inline double HSum (SIMD<double,8> a)
+  {
+    __m256d lo = _mm512_maskz_extractf64x4_pd(0xF, a.Val(), 0);
+    __m256d hi = _mm512_maskz_extractf64x4_pd(0xF, a.Val(), 1);
+    return HSum(SIMD<double,4>(_mm256_add_pd(lo, hi)));
+  }
+  inline SIMD<double,8> DupEven (SIMD<double,8> a) { return _mm512_movedup_pd(a.Val()); }
+  inline SIMD<double,8> DupOdd (SIMD<double,8> a) { return _mm512_permute_pd(a.Val(), 0xFF); }
+  inline SIMD<double,8> SwapPairs (SIMD<double,8> a) { return _mm512_permute_pd(a.Val(), 0x55); }
+
+  /*
+    pairs of rows interleaved, then two rounds of 128-bit lane shuffles.
+    All steps are two-source permutes, which (unlike unpack/shuffle with
+    GCC 12) do not read an undefined pass-through register.
+  */
+  inline void Transpose (SIMD<double,8> (&a)[8])
+  {
+    const __m512i lo = _mm512_setr_epi64(0, 8, 2, 10, 4, 12, 6, 14);
+    const __m512i hi = _mm512_setr_epi64(1, 9, 3, 11, 5, 13, 7, 15);
+    const __m512i even = _mm512_setr_epi64(0, 1, 4, 5, 8, 9, 12, 13);   // lanes 0,2 of both
+    const __m512i odd = _mm512_setr_epi64(2, 3, 6, 7, 10, 11, 14, 15);  // lanes 1,3 of both
+    __m512d t[8], u[8];
+    for (int k = 0; k < 4; k++)
+      {
+        t[2*k]   = _mm512_permutex2var_pd(a[2*k].Val(), lo, a[2*k+1].Val());
+        t[2*k+1] = _mm512_permutex2var_pd(a[2*k].Val(), hi, a[2*k+1].Val());
+      }
+    // u[0..3]: rows 0-3, columns (0,4), (2,6), (1,5), (3,7); u[4..7] the same for rows 4-7
+    for (int k = 0; k < 2; k++)
+      for (int l = 0; l < 2; l++)
+        {
+          u[4*k+2*l]   = _mm512_permutex2var_pd(t[4*k+l], even, t[4*k+l+2]);
+          u[4*k+2*l+1] = _mm512_permutex2var_pd(t[4*k+l], odd, t[4*k+l+2]);
+        }
+    const int col[4] = { 0, 2, 1, 3 };
+    for (int k = 0; k < 4; k++)
+      {
+        a[col[k]]   = _mm512_permutex2var_pd(u[k], even, u[k+4]);
+        a[col[k]+4] = _mm512_permutex2var_pd(u[k], odd, u[k+4]);
+      }
+  }
+
+
+  template<>
+  class SIMD<float,16>
+  {
+    __m512 m_val;
+    static __mmask16 Mask (size_t n) { return __mmask16((1u << n) - 1); }
+  public:
+    static constexpr size_t Size() { return 16; }
+    SIMD () = default;
+    SIMD (__m512 val) : m_val(val) { }
+    SIMD (float val) : m_val(_mm512_set1_ps(val)) { }
+    SIMD (const float* p) : m_val(_mm512_loadu_ps(p)) { }
+    SIMD (const float* p, size_t n)
+      : m_val( (n >= 16) ? _mm512_loadu_ps(p) : _mm512_maskz_loadu_ps(Mask(n), p)) { }
+
+    void Store (float* p) const { _mm512_storeu_ps(p, m_val); }
+    void Store (float* p, size_t n) const
+    {
+      if (n >= 16) _mm512_storeu_ps(p, m_val);
+      else _mm512_mask_storeu_ps(p, Mask(n), m_val);
+    }
+
+    __m512 Val() const { return m_val; }
+    float operator[] (size_t i) const { alignas(64) float v[16]; _mm512_store_ps(v, m_val); return v[i]; }
+  };
+
+  inline SIMD<float,16> operator+ (SIMD<float,16> a, SIMD<float,16> b) { return _mm512_add_ps(a.Val(), b.Val()); }
+  inline SIMD<float,16> operator- (SIMD<float,16> a, SIMD<float,16> b) { return _mm512_sub_ps(a.Val(), b.Val()); }
+  inline SIMD<float,16> operator* (SIMD<float,16> a, SIMD<float,16> b) { return _mm512_mul_ps(a.Val(), b.Val()); }
+  inline SIMD<float,16> operator- (SIMD<float,16> a) { return _mm512_sub_ps(_mm512_setzero_ps(), a.Val()); }
+  inline SIMD<float,16> FMA (SIMD<float,16> a, SIMD<float,16> b, SIMD<float,16> c)
+  { return _mm512_fmadd_ps(a.Val(), b.Val(), c.Val()); }
+  inline float HSum (SIMD<float,16> a)
+  {
+    __m256 lo = _mm256_castpd_ps(_mm512_maskz_extractf64x4_pd(0xF, _mm512_castps_pd(a.Val()), 0));
+    __m256 hi = _mm256_castpd_ps(_mm512_maskz_extractf64x4_pd(0xF, _mm512_castps_pd(a.Val()), 1));
+    return HSum(SIMD<float,8>(_mm256_add_ps(lo, hi)));
+  }
+
+#endif
+
+
+
+  // ********************** complex<double> *********************
+
+  // N complex numbers, stored interleaved in 2N doubles
+  template <size_t N>
+  class SIMD<std::complex<double>,N>
+  {
+    SIMD<double,2*N> m_val;
+  public:
+    static constexpr size_t Size() { return N; }
+    SIMD () = default;
+    SIMD (SIMD<double,2*N> val) : m_val(val) { }
+    SIMD (std::complex<double> val)
+    {
+      alignas(64) double v[2*N];
+      for (size_t i = 0; i < N; i++)
+        { v[2*i] = val.real(); v[2*i+1] = val.imag(); }
+      m_val = SIMD<double,2*N>(v);
+    }
+    SIMD (const std::complex<double>* p)
+      : m_val(reinterpret_cast<const double*>(p)) { }
+    SIMD (const std::complex<double>* p, size_t n)
+      : m_val(reinterpret_cast<const double*>(p), 2*n) { }
+
+    void Store (std::complex<double>* p) const { m_val.Store(reinterpret_cast<double*>(p)); }
+    void Store (std::complex<double>* p, size_t n) const { m_val.Store(reinterpret_cast<double*>(p), 2*n); }
+
+    SIMD<double,2*N> Val() const { return m_val; }
+    std::complex<double> operator[] (size_t i) const { return { m_val[2*i], m_val[2*i+1] }; }
+  };
+
+  template <size_t N>
+  auto operator+ (SIMD<std::complex<double>,N> a, SIMD<std::complex<double>,N> b)
+  { return SIMD<std::complex<double>,N> (a.Val()+b.Val()); }
+
+  template <size_t N>
+  auto operator- (SIMD<std::complex<double>,N> a, SIMD<std::complex<double>,N> b)
+  { return SIMD<std::complex<double>,N> (a.Val()-b.Val()); }
+
+  template <size_t N>
+  auto operator- (SIMD<std::complex<double>,N> a)
+  { return SIMD<std::complex<double>,N> (-a.Val()); }
+
+  // (ar+i ai)*(br+i bi) = (ar br - ai bi) + i (ar bi + ai br)
+  template <size_t N>
+  auto operator* (SIMD<std::complex<double>,N> a, SIMD<std::complex<double>,N> b)
+  {
+    alignas(64) double sign[2*N];
+    for (size_t i = 0; i < N; i++)
+      { sign[2*i] = -1; sign[2*i+1] = 1; }
+    auto t1 = DupEven(a.Val()) * b.Val();
+    auto t2 = DupOdd(a.Val()) * SwapPairs(b.Val());
+    return SIMD<std::complex<double>,N> (FMA(t2, SIMD<double,2*N>(sign), t1));
+  }
+
+  template <size_t N>
+  auto FMA (SIMD<std::complex<double>,N> a, SIMD<std::complex<double>,N> b, SIMD<std::complex<double>,N> c)
+  { return a*b+c; }
+
+  template <size_t N>
+  std::complex<double> HSum (SIMD<std::complex<double>,N> a)
+  {
+    std::complex<double> sum = 0;
+    for (size_t i = 0; i < N; i++)
+      sum += a[i];
+    return sum;
+  }
+
+}
+}
+
+#endif
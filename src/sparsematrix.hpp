@@ -0,0 +1,281 @@
+#ifndef FILE_SPARSEMATRIX
+#define FILE_SPARSEMATRIX
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <stdexcept>
+
+#include "vector.hpp"
+
+namespace nanoblas
+{
+
+  /*
+    Sparse matrix in compressed sparse row (CSR) format
+
+    The non-zero entries of row i are values()[k] in columns colind()[k],
+    for k in [firstinrow()[i], firstinrow()[i+1]), sorted by column.
+
+    A*x is a vector expression, each entry is the product of one row
+    with x. Explicit kernels are MultAdd (y += alpha A x) and
+    MultTransAdd (y += alpha A^T x).
+  */
+
+  template <typename T=double>
+  class SparseMatrix
+  {
+    size_t m_rows, m_cols;
+    std::vector<size_t> m_firstinrow;
+    std::vector<size_t> m_colind;
+    std::vector<T> m_values;
+
+  public:
+    SparseMatrix (size_t rows, size_t cols)
+      : m_rows(rows), m_cols(cols), m_firstinrow(rows+1, 0) { }
+
+    // from CSR arrays
+    static SparseMatrix FromCSR (size_t rows, size_t cols, std::vector<size_t> firstinrow,
+                                 std::vector<size_t> colind, std::vector<T> values)
+    {
+      if (firstinrow.size() != rows+1 || colind.size() != firstinrow[rows]
+          || values.size() != colind.size())
+        throw std::invalid_argument("SparseMatrix: inconsistent CSR arrays");
+      SparseMatrix mat(rows, cols);
+      mat.m_firstinrow = std::move(firstinrow);
+      mat.m_colind = std::move(colind);
+      mat.m_values = std::move(values);
+      return mat;
+    }
+
+    /*
+      from triplets (ii[k], jj[k], vals[k]), duplicates are added up
+      in the order of the triplets. Rows are bucketed in parallel,
+      then every row is sorted and merged by its own task.
+    */
+    SparseMatrix (size_t rows, size_t cols, const std::vector<size_t>& ii,
+                  const std::vector<size_t>& jj, const std::vector<T>& vals)
+      : m_rows(rows), m_cols(cols), m_firstinrow(rows+1)
+    {
+      size_t nnz = ii.size();
+      if (jj.size() != nnz || vals.size() != nnz)
+        throw std::invalid_argument("SparseMatrix: triplet arrays of different size");
+      for (size_t k = 0; k < nnz; k++)
+        if (ii[k] >= rows || jj[k] >= cols)
+          throw std::invalid_argument("SparseMatrix: triplet index out of range");
+
+      // bucket the triplets by row
+      std::vector<std::atomic<size_t>> cnt(rows);
+      ParallelFor (nnz, [&] (size_t k) { cnt[ii[k]].fetch_add(1, std::memory_order_relaxed); },
+                   VEC_PARALLEL_GRAIN);
+
+      std::vector<size_t> start(rows+1);
+      start[0] = 0;
+      for (size_t i = 0; i < rows; i++)
+        {
+          start[i+1] = start[i] + cnt[i];
+          cnt[i] = start[i];
+        }
+
+      std::vector<size_t> perm(nnz);
+      ParallelFor (nnz, [&] (size_t k) { perm[cnt[ii[k]].fetch_add(1, std::memory_order_relaxed)] = k; },
+                   VEC_PARALLEL_GRAIN);
+
+      // sort every row by (column, triplet number), count distinct columns
+      size_t grain = std::max<size_t>(1, rows * 4096 / std::max<size_t>(nnz,1));
+      std::vector<size_t> rowsize(rows);
+      ParallelFor (rows, [&] (size_t i)
+      {
+        auto first = perm.begin()+start[i], next = perm.begin()+start[i+1];
+        std::sort (first, next, [&jj] (size_t k1, size_t k2)
+        { return (jj[k1] < jj[k2]) || (jj[k1] == jj[k2] && k1 < k2); });
+        size_t n = 0;
+        for (auto it = first; it != next; ++it)
+          if (it == first || jj[*it] != jj[*(it-1)])
+            n++;
+        rowsize[i] = n;
+      }, grain);
+
+      m_firstinrow[0] = 0;
+      for (size_t i = 0; i < rows; i++)
+        m_firstinrow[i+1] = m_firstinrow[i] + rowsize[i];
+      m_colind.resize(m_firstinrow[rows]);
+      m_values.resize(m_firstinrow[rows]);
+
+      // merge duplicates
+      ParallelFor (rows, [&] (size_t i)
+      {
+        size_t pos = m_firstinrow[i];
+        for (size_t l = start[i]; l < start[i+1]; l++)
+          {
+            size_t k = perm[l];
+            if (l > start[i] && jj[k] == jj[perm[l-1]])
+              m_values[pos-1] += vals[k];
+            else
+              {
+                m_colind[pos] = jj[k];
+                m_values[pos] = vals[k];
+                pos++;
+              }
+          }
+      }, grain);
+    }
+
+    size_t rows() const { return m_rows; }
+    size_t cols() const { return m_cols; }
+    size_t nnz() const { return m_colind.size(); }
+
+    const std::vector<size_t>& firstinrow() const { return m_firstinrow; }
+    const std::vector<size_t>& colind() const { return m_colind; }
+    const std::vector<T>& values() const { return m_values; }
+    std::vector<T>& values() { return m_values; }
+
+    // entry (i,j), zero if not in the pattern
+    T operator() (size_t i, size_t j) const
+    {
+      auto first = m_colind.begin()+m_firstinrow[i], next = m_colind.begin()+m_firstinrow[i+1];
+      auto pos = std::lower_bound (first, next, j);
+      if (pos == next || *pos != j) return T(0);
+      return m_values[pos - m_colind.begin()];
+    }
+
+    // product of row i with x
+    template <typename TX>
+    auto RowTimes (size_t i, const TX& x) const
+    {
+      using TSCAL = decltype(std::declval<T>()*x(0));
+      // two accumulators to hide the FMA latency
+      TSCAL sum0 = 0, sum1 = 0;
+      size_t k = m_firstinrow[i], next = m_firstinrow[i+1];
+      for ( ; k+2 <= next; k += 2)
+        {
+          sum0 += m_values[k] * x(m_colind[k]);
+          sum1 += m_values[k+1] * x(m_colind[k+1]);
+        }
+      if (k < next)
+        sum0 += m_values[k] * x(m_colind[k]);
+      return sum0 + sum1;
+    }
+
+    // rows per task, such that a task has about 16k non-zeros
+    size_t RowGrain() const
+    {
+      return std::max<size_t>(1, m_rows * 16384 / std::max<size_t>(nnz(), 1));
+    }
+
+    // y += alpha * A * x
+    template <typename TDX, typename TDY>
+    void MultAdd (T alpha, VectorView<T,TDX> x, VectorView<T,TDY> y) const
+    {
+      assert(x.size() == m_cols && y.size() == m_rows);
+      ParallelForRange (m_rows, [this,alpha,&x,&y] (size_t first, size_t next)
+      {
+        for (size_t i = first; i < next; i++)
+          y(i) += alpha * RowTimes(i, x);
+      }, RowGrain());
+    }
+
+    /*
+      y += alpha * A^T * x
+      rows are split into one chunk per thread, every chunk
+      scatters into a private vector, which are added up afterwards
+    */
+    template <typename TDX, typename TDY>
+    void MultTransAdd (T alpha, VectorView<T,TDX> x, VectorView<T,TDY> y) const
+    {
+      assert(x.size() == m_rows && y.size() == m_cols);
+
+      size_t nchunks = std::min(GetNumThreads(), std::max<size_t>(1, nnz() / 16384));
+      std::vector<std::vector<T>> partial(nchunks-1);
+
+      ParallelFor (nchunks, [&] (size_t c)
+      {
+        size_t first = c*m_rows/nchunks, next = (c+1)*m_rows/nchunks;
+        auto scatter = [&] (auto && yc)
+        {
+          for (size_t i = first; i < next; i++)
+            {
+              T xi = alpha * x(i);
+              for (size_t k = m_firstinrow[i]; k < m_firstinrow[i+1]; k++)
+                yc(m_colind[k]) += m_values[k] * xi;
+            }
+        };
+        if (c == 0)
+          scatter (y);
+        else
+          {
+            partial[c-1].assign(m_cols, T(0));
+            scatter ([&p = partial[c-1]] (size_t j) -> T& { return p[j]; });
+          }
+      });
+
+      if (nchunks > 1)
+        ParallelForRange (m_cols, [&] (size_t first, size_t next)
+        {
+          for (auto & p : partial)
+            for (size_t j = first; j < next; j++)
+              y(j) += p[j];
+        }, VEC_PARALLEL_GRAIN/8);
+    }
+
+    // the transposed matrix in CSR format
+    SparseMatrix Transpose() const
+    {
+      std::vector<size_t> ii(nnz()), jj(m_colind);
+      for (size_t i = 0; i < m_rows; i++)
+        for (size_t k = m_firstinrow[i]; k < m_firstinrow[i+1]; k++)
+          ii[k] = i;
+      return SparseMatrix(m_cols, m_rows, jj, ii, m_values);
+    }
+  };
+
+
+
+  // ************************ SparseMatVecExpr *********************
+
+  template <typename T, typename TX>
+  class SparseMatVecExpr : public VecExpr<SparseMatVecExpr<T,TX>>
+  {
+    T m_scal;
+    const SparseMatrix<T>& m_mat;
+    TX m_x;
+  public:
+    SparseMatVecExpr (T scal, const SparseMatrix<T>& mat, TX x)
+      : m_scal(scal), m_mat(mat), m_x(x) { }
+    size_t size() const { return m_mat.rows(); }
+    bool Overlaps (const MemoryRange& t, bool /* entrywise */) const
+    { return ExprOverlaps(m_x, t, false); }
+    auto operator() (size_t i) const { return m_scal * m_mat.RowTimes(i, m_x); }
+  };
+
+  // scal * A, only used to build scal * A * x
+  template <typename T>
+  struct ScaleSparseMatrix
+  {
+    T scal;
+    const SparseMatrix<T>& mat;
+  };
+
+  template <typename TSCAL, typename T> requires (isScalar<TSCAL>())
+  auto operator* (TSCAL scal, const SparseMatrix<T>& mat)
+  {
+    return ScaleSparseMatrix<T>{ T(scal), mat };
+  }
+
+  template <typename T, typename TX>
+  auto operator* (const SparseMatrix<T>& mat, const VecExpr<TX>& x)
+  {
+    assert(mat.cols() == x.size());
+    return SparseMatVecExpr<T,expr_storage_t<TX>>(T(1), mat, x.derived());
+  }
+
+  template <typename T, typename TX>
+  auto operator* (ScaleSparseMatrix<T> smat, const VecExpr<TX>& x)
+  {
+    assert(smat.mat.cols() == x.size());
+    return SparseMatVecExpr<T,expr_storage_t<TX>>(smat.scal, smat.mat, x.derived());
+  }
+
+}
+
+#endif
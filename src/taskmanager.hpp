@@ -0,0 +1,357 @@
+#ifndef FILE_TASKMANAGER
+#define FILE_TASKMANAGER
+
+#include <cstddef>
+#include <cstdlib>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <utility>
+
+#include "profiler.hpp"
+
+namespace nanoblas
+{
+
+  /*
+    Task manager: a persistent pool of worker threads with work-stealing
+
+    ParallelForRange (n, f, grain) calls f(first,next) for sub-ranges of [0,n).
+    A task owning more than grain entries splits off its upper half
+    and pushes it to the deque of the executing thread, idle threads
+    steal from the other end of foreign deques. The calling thread
+    takes part in the work until the whole range is done, so parallel
+    loops may be nested.
+
+    The number of threads (including the calling one) is taken from the
+    environment variable NANOBLAS_NUM_THREADS, or the hardware concurrency,
+    and can be changed by SetNumThreads. Parallel loops of outside threads
+    count as active jobs; SetNumThreads waits until there are none, and
+    new loops wait until the pool is restarted. So other threads (e.g.
+    Python threads without the GIL) may run kernels meanwhile, but a
+    parallel loop itself must not call SetNumThreads.
+  */
+
+  class TaskManager
+  {
+    struct Job
+    {
+      const std::function<void(size_t,size_t)>* func;
+      size_t grain;
+      std::atomic<size_t> remaining;
+    };
+
+    struct Task
+    {
+      Job* job;
+      size_t first, next;
+    };
+
+    struct alignas(64) Queue
+    {
+      std::mutex mutex;
+      std::deque<Task> tasks;
+    };
+
+    std::atomic<size_t> m_num_threads{1};
+    std::vector<std::thread> m_workers;
+    // one deque per worker, the last one is shared by all outside threads
+    std::unique_ptr<Queue[]> m_queues;
+    std::atomic<size_t> m_queued{0};
+    std::atomic<size_t> m_sleeping{0};
+    std::atomic<bool> m_stop{false};
+    std::mutex m_sleep_mutex;
+    std::condition_variable m_wakeup;
+
+    // top level parallel loops of outside threads, and a resize of the pool
+    std::atomic<size_t> m_active{0};
+    std::atomic<bool> m_resizing{false};
+    std::mutex m_resize_mutex;
+
+    static inline thread_local int t_queue = -1;
+    static inline thread_local bool t_active = false;
+
+    // registers the loop of an outside thread, nested loops are part of the outer one
+    class ActiveJob
+    {
+      TaskManager & m_tm;
+      bool m_outer;
+    public:
+      ActiveJob (TaskManager & tm)
+        : m_tm(tm), m_outer(t_queue < 0 && !t_active)
+      {
+        if (!m_outer) return;
+        while (true)
+          {
+            m_tm.m_active++;
+            if (!m_tm.m_resizing) break;
+            m_tm.m_active--;
+            std::lock_guard<std::mutex> wait(m_tm.m_resize_mutex);
+          }
+        t_active = true;
+      }
+      ~ActiveJob ()
+      {
+        if (!m_outer) return;
+        t_active = false;
+        m_tm.m_active--;
+      }
+    };
+
+  public:
+    TaskManager () { Start (DefaultNumThreads()); }
+    ~TaskManager () { Stop(); }
+
+    static TaskManager& Instance()
+    {
+      static TaskManager tm;
+      return tm;
+    }
+
+    static size_t DefaultNumThreads()
+    {
+      if (const char* env = std::getenv("NANOBLAS_NUM_THREADS"))
+        if (int n = std::atoi(env); n > 0)
+          return n;
+      return std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+
+    size_t NumThreads() const { return m_num_threads; }
+
+    // waits until the parallel loops of other threads are done
+    void SetNumThreads (size_t n)
+    {
+      if (n == 0) n = DefaultNumThreads();
+      std::lock_guard<std::mutex> lock(m_resize_mutex);
+      if (n == m_num_threads) return;
+      m_resizing = true;
+      while (m_active > 0)
+        std::this_thread::yield();
+      Stop();
+      Start(n);
+      m_resizing = false;
+    }
+
+    void Run (size_t n, const std::function<void(size_t,size_t)>& func, size_t grain)
+    {
+      grain = std::max<size_t>(grain, 1);
+      if (n <= grain)
+        {
+          if (n > 0) func(0, n);
+          return;
+        }
+
+      ActiveJob active(*this);
+      if (m_num_threads == 1)
+        {
+          func(0, n);
+          return;
+        }
+
+      Job job { &func, grain, n };
+      Execute (Task{&job, 0, n});
+
+      while (job.remaining.load(std::memory_order_acquire) > 0)
+        {
+          Task task;
+          if (GetTask(task))
+            Execute(task);
+          else
+            std::this_thread::yield();
+        }
+    }
+
+  private:
+    void Start (size_t n)
+    {
+      m_num_threads = std::max<size_t>(n, 1);
+      m_queues = std::make_unique<Queue[]>(m_num_threads);
+      m_stop = false;
+      for (size_t i = 0; i+1 < m_num_threads; i++)
+        m_workers.emplace_back([this, i] { Worker(i); });
+    }
+
+    void Stop()
+    {
+      m_stop = true;
+      {
+        std::lock_guard<std::mutex> lock(m_sleep_mutex);
+        m_wakeup.notify_all();
+      }
+      for (auto & w : m_workers)
+        w.join();
+      m_workers.clear();
+    }
+
+    void Worker (size_t id)
+    {
+      t_queue = id;
+      size_t idle = 0;
+      while (!m_stop)
+        {
+          Task task;
+          if (GetTask(task))
+            {
+              Execute(task);
+              idle = 0;
+              continue;
+            }
+          if (++idle < 1024)
+            {
+              std::this_thread::yield();
+              continue;
+            }
+
+          m_sleeping++;
+          {
+            std::unique_lock<std::mutex> lock(m_sleep_mutex);
+            m_wakeup.wait(lock, [this] { return m_stop || m_queued > 0; });
+          }
+          m_sleeping--;
+          idle = 0;
+        }
+    }
+
+    size_t MyQueue() const { return (t_queue >= 0) ? t_queue : m_num_threads-1; }
+
+    void Push (Task task)
+    {
+      Queue & q = m_queues[MyQueue()];
+      {
+        std::lock_guard<std::mutex> lock(q.mutex);
+        q.tasks.push_back(task);
+      }
+      m_queued++;
+      if (m_sleeping > 0)
+        {
+          std::lock_guard<std::mutex> lock(m_sleep_mutex);
+          m_wakeup.notify_one();
+        }
+    }
+
+    // newest task from the own deque, otherwise steal the oldest task of another one
+    bool GetTask (Task & task)
+    {
+      if (m_queued == 0) return false;
+      size_t me = MyQueue();
+      for (size_t k = 0; k < m_num_threads; k++)
+        {
+          Queue & q = m_queues[(me+k) % m_num_threads];
+          std::lock_guard<std::mutex> lock(q.mutex);
+          if (q.tasks.empty()) continue;
+          if (k == 0)
+            {
+              task = q.tasks.back();
+              q.tasks.pop_back();
+            }
+          else
+            {
+              task = q.tasks.front();
+              q.tasks.pop_front();
+            }
+          m_queued--;
+          return true;
+        }
+      return false;
+    }
+
+    void Execute (Task task)
+    {
+      Job & job = *task.job;
+      while (task.next - task.first > job.grain)
+        {
+          size_t nblocks = (task.next - task.first + job.grain-1) / job.grain;
+          size_t mid = task.first + nblocks/2 * job.grain;
+          Push (Task{task.job, mid, task.next});
+          task.next = mid;
+        }
+      (*job.func)(task.first, task.next);
+      // last access to the job, the owner may return afterwards
+      job.remaining.fetch_sub(task.next-task.first, std::memory_order_acq_rel);
+    }
+  };
+
+
+  inline size_t GetNumThreads() { return TaskManager::Instance().NumThreads(); }
+
+  // n = 0 resets to the default
+  inline void SetNumThreads (size_t n) { TaskManager::Instance().SetNumThreads(n); }
+
+
+  // f(first, next) for sub-ranges of [0,n) of at least grain entries (but the last)
+  template <typename F>
+  void ParallelForRange (size_t n, const F& f, size_t grain = 1)
+  {
+    if (n <= grain)
+      {
+        if (n > 0) f(size_t(0), n);
+        return;
+      }
+    std::function<void(size_t,size_t)> func = [&f] (size_t first, size_t next) { f(first, next); };
+
+    // hardware counters of tasks stolen by other threads go to the calling kernel
+    Profiler::Counter* kernel = Profiler::Current();
+    if (kernel && PerfCounting::Active())
+      {
+        auto owner = std::this_thread::get_id();
+        func = [&f, kernel, owner] (size_t first, size_t next)
+        {
+          if (std::this_thread::get_id() == owner)
+            {
+              f(first, next);
+              return;
+            }
+          PerfTaskRegion region(*kernel);
+          Profiler::Counter* outer = std::exchange(Profiler::Current(), kernel);
+          f(first, next);
+          Profiler::Current() = outer;
+        };
+      }
+    TaskManager::Instance().Run(n, func, grain);
+  }
+
+  // f(i) for i in [0,n)
+  template <typename F>
+  void ParallelFor (size_t n, const F& f, size_t grain = 1)
+  {
+    ParallelForRange (n, [&f] (size_t first, size_t next)
+    {
+      for (size_t i = first; i < next; i++)
+        f(i);
+    }, grain);
+  }
+
+  /*
+    combine (init, f(0,grain), f(grain,2*grain), ...)
+    chunks depend on n and grain only, so the result does not
+    depend on the number of threads
+  */
+  template <typename T, typename F, typename TCOMB>
+  T ParallelReduce (size_t n, const F& f, T init, const TCOMB& combine, size_t grain = 1)
+  {
+    grain = std::max<size_t>(grain, 1);
+    if (n == 0) return init;
+    if (n <= grain) return combine(init, f(size_t(0), n));
+
+    size_t nchunks = (n + grain-1) / grain;
+    std::vector<T> partial(nchunks);
+    ParallelFor (nchunks, [&] (size_t c)
+    {
+      partial[c] = f(c*grain, std::min(n, (c+1)*grain));
+    });
+
+    T sum = init;
+    for (auto & p : partial)
+      sum = combine(sum, p);
+    return sum;
+  }
+
+}
+
+#endif
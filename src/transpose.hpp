@@ -0,0 +1,114 @@
+#ifndef FILE_TRANSPOSE
+#define FILE_TRANSPOSE
+
+#include <cstddef>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+
+#include "kernels.hpp"
+#include "taskmanager.hpp"
+#include "vecexpr.hpp"
+
+namespace nanoblas
+{
+
+  /*
+    Copy and transpose kernels for matrices stored by rows
+    (a is m x n, row distance lda):
+
+      CopyKernel               b(i,j) = alpha * a(i,j)
+      TransposeKernel          b(j,i) = alpha * a(i,j)
+      TransposeInPlaceKernel   square a overwritten by a^T
+
+    Converting between RowMajor and ColMajor transposes the stored
+    array. A naive loop reads or writes with stride lda, touching a new
+    cache line (and soon a new page) for every entry. Instead, the
+    matrix is halved recursively (cache-oblivious) down to tiles of
+    TRANSPOSE_TILE x TRANSPOSE_TILE, which fit into L1 for both a and b.
+    Inside a tile, W x W blocks (W = SIMD width) are loaded by rows,
+    transposed in registers and stored by rows. The recursion is the
+    transpose kernel of Kernels<T>() (kernels.hpp), panels of rows are
+    distributed to the task manager.
+  */
+
+  template <typename T>
+  void TransposeKernel (size_t m, size_t n, T alpha, const T* a, size_t lda, T* b, size_t ldb)
+  {
+    // panels of TRANSPOSE_TILE rows of a, about VEC_PARALLEL_GRAIN entries per task
+    size_t npanels = (m+TRANSPOSE_TILE-1) / TRANSPOSE_TILE;
+    size_t grain = std::max<size_t>(1, VEC_PARALLEL_GRAIN / std::max<size_t>(1, n*TRANSPOSE_TILE));
+    auto kernel = Kernels<T>().transpose;
+    ParallelForRange (npanels, [&] (size_t first, size_t next)
+    {
+      size_t i0 = first*TRANSPOSE_TILE, i1 = std::min(m, next*TRANSPOSE_TILE);
+      kernel (i1-i0, n, alpha, a+i0*lda, lda, b+i0, ldb);
+    }, grain);
+  }
+
+  template <typename T>
+  void CopyKernel (size_t m, size_t n, T alpha, const T* a, size_t lda, T* b, size_t ldb)
+  {
+    ParallelForRange (m, [&] (size_t first, size_t next)
+    {
+      for (size_t i = first; i < next; i++)
+        for (size_t j = 0; j < n; j++)
+          b[i*ldb+j] = alpha * a[i*lda+j];
+    }, std::max<size_t>(1, VEC_PARALLEL_GRAIN / std::max<size_t>(1, n)));
+  }
+
+  /*
+    a = a^T for a square n x n matrix: the W x W blocks (i,j) and (j,i)
+    are transposed in registers and exchanged. Tasks take block rows of
+    tiles, and the tiles right of the diagonal together with their mirror.
+  */
+  template <typename T>
+  void TransposeInPlaceKernel (size_t n, T* a, size_t lda)
+  {
+    constexpr size_t W = TransposeWidth<T>();
+    size_t nw = n / W * W;
+
+    auto swapblocks = [a, lda] (size_t i, size_t j)
+    {
+      if constexpr (W > 1)
+        {
+          SIMD<T,W> r[W], s[W];
+          for (size_t k = 0; k < W; k++)
+            {
+              r[k] = SIMD<T,W>(a+(i+k)*lda+j);
+              s[k] = SIMD<T,W>(a+(j+k)*lda+i);
+            }
+          Transpose (r);
+          Transpose (s);
+          for (size_t k = 0; k < W; k++)
+            {
+              r[k].Store (a+(j+k)*lda+i);
+              s[k].Store (a+(i+k)*lda+j);
+            }
+        }
+      else
+        std::swap (a[i*lda+j], a[j*lda+i]);
+    };
+
+    size_t ntiles = (nw+TRANSPOSE_TILE-1) / TRANSPOSE_TILE;
+    ParallelFor (ntiles, [&] (size_t ti)
+    {
+      size_t i0 = ti*TRANSPOSE_TILE, i1 = std::min(nw, i0+TRANSPOSE_TILE);
+      for (size_t j0 = i0; j0 < nw; j0 += TRANSPOSE_TILE)
+        {
+          size_t j1 = std::min(nw, j0+TRANSPOSE_TILE);
+          for (size_t i = i0; i < i1; i += W)
+            for (size_t j = (j0 == i0) ? i : j0; j < j1; j += W)
+              swapblocks (i, j);
+        }
+    }, std::max<size_t>(1, VEC_PARALLEL_GRAIN / std::max<size_t>(1, n*TRANSPOSE_TILE)));
+
+    // rows and columns beyond the last full block
+    for (size_t i = nw; i < n; i++)
+      for (size_t j = 0; j < i; j++)
+        std::swap (a[i*lda+j], a[j*lda+i]);
+  }
+
+}
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef FILE_TRIANGULAR
+#define FILE_TRIANGULAR
+
+#include "matrix.hpp"
+
+namespace nanoblas
+{
+
+  /*
+    Triangular solve with multiple right hand sides (trsm):
+
+      b = tri^{-1} b
+
+    only the lower (Lower) or upper (Upper) triangle of tri is used,
+    for DIAG == Unit the diagonal is assumed to be one.
+
+    Recursive blocking: the triangle is split in halves, the
+    off-diagonal block updates the right hand side with the GEMM kernel,
+    small triangles are solved by substitution.
+  */
+
+  enum TRIANGULAR { Lower, Upper };
+  enum DIAGONAL { NonUnit, Unit };
+
+  constexpr size_t TRSM_BLOCK = 64;
+
+  template <TRIANGULAR UPLO, DIAGONAL DIAG=NonUnit, typename T, ORDERING OT, ORDERING OB>
+  void TriangularSolve (MatrixView<T,OT> tri, MatrixView<T,OB> b)
+  {
+    size_t n = tri.rows();
+    assert(tri.cols() == n && b.rows() == n);
+
+    if (n <= TRSM_BLOCK)
+      {
+        if constexpr (UPLO == Lower)
+          for (size_t i = 0; i < n; i++)
+            {
+              if constexpr (DIAG == NonUnit)
+                {
+                  T inv = T(1) / tri(i,i);
+                  for (size_t j = 0; j < b.cols(); j++)
+                    b(i,j) *= inv;
+                }
+              for (size_t r = i+1; r < n; r++)
+                {
+                  T f = tri(r,i);
+                  for (size_t j = 0; j < b.cols(); j++)
+                    b(r,j) -= f * b(i,j);
+                }
+            }
+        else
+          for (size_t i = n; i-- > 0; )
+            {
+              if constexpr (DIAG == NonUnit)
+                {
+                  T inv = T(1) / tri(i,i);
+                  for (size_t j = 0; j < b.cols(); j++)
+                    b(i,j) *= inv;
+                }
+              for (size_t r = 0; r < i; r++)
+                {
+                  T f = tri(r,i);
+                  for (size_t j = 0; j < b.cols(); j++)
+                    b(r,j) -= f * b(i,j);
+                }
+            }
+        return;
+      }
+
+    size_t n1 = n/2;
+    auto t11 = tri.rows(0,n1).cols(0,n1);
+    auto t22 = tri.rows(n1,n).cols(n1,n);
+    auto b1 = b.rows(0,n1);
+    auto b2 = b.rows(n1,n);
+
+    if constexpr (UPLO == Lower)
+      {
+        TriangularSolve<UPLO,DIAG> (t11, b1);
+        AddMultMatMat (T(-1), tri.rows(n1,n).cols(0,n1), b1, b2);
+        TriangularSolve<UPLO,DIAG> (t22, b2);
+      }
+    else
+      {
+        TriangularSolve<UPLO,DIAG> (t22, b2);
+        AddMultMatMat (T(-1), tri.rows(0,n1).cols(n1,n), b2, b1);
+        TriangularSolve<UPLO,DIAG> (t11, b1);
+      }
+  }
+
+
+  /*
+    Symmetric rank-k update (syrk), lower triangle:
+
+      c += alpha * a * a^T
+
+    only the lower triangle of c is updated. Recursive blocking as for
+    the triangular solve: off-diagonal blocks are updated with the GEMM
+    kernel, small diagonal blocks are computed in full by GEMM into a
+    temporary, and their lower triangle is added.
+  */
+
+  constexpr size_t SYRK_BLOCK = 32;
+
+  template <typename T, ORDERING OA, ORDERING OC>
+  void SymmetricRankUpdate (T alpha, MatrixView<T,OA> a, MatrixView<T,OC> c)
+  {
+    size_t n = c.rows();
+    assert(c.cols() == n && a.rows() == n);
+
+    if (n <= SYRK_BLOCK)
+      {
+        Matrix<T,OC> tmp(n,n);
+        tmp = T(0);
+        AddMultMatMat (alpha, a, trans(a), MatrixView<T,OC>(tmp));
+        for (size_t i = 0; i < n; i++)
+          for (size_t j = 0; j <= i; j++)
+            c(i,j) += tmp(i,j);
+        return;
+      }
+
+    size_t n1 = n/2;
+    auto a1 = a.rows(0,n1);
+    auto a2 = a.rows(n1,n);
+    SymmetricRankUpdate (alpha, a1, c.rows(0,n1).cols(0,n1));
+    AddMultMatMat (alpha, a2, trans(a1), c.rows(n1,n).cols(0,n1));
+    SymmetricRankUpdate (alpha, a2, c.rows(n1,n).cols(n1,n));
+  }
+
+}
+
+#endif
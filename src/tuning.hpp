@@ -0,0 +1,361 @@
+#ifndef FILE_TUNING
+#define FILE_TUNING
+
+#include <cstddef>
+#include <cstdlib>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "gemm.hpp"
+
+namespace nanoblas
+{
+
+  /*
+    Tuned GEMM blocking, persisted per host
+
+    GemmParameters<T>() are the micro-tile and the cache blocking used
+    by the matrix product. At the first call they are read from the
+    profile of this host,
+
+      $NANOBLAS_TUNE_FILE, or ~/.config/nanoblas/<hostname>.tune
+
+    with one line per element type and instruction set, e.g.
+
+      double avx512 mr=8 nr=16 mc=96 kc=384 nc=4096
+
+    If there is no entry and NANOBLAS_TUNE=1 is set, TuneGemm<T>() is run
+    first and its result added to the profile. The executable nanoblas_tune
+    does the same for float and double. Otherwise the defaults of
+    GemmParams are used. Only float and double are tuned.
+  */
+
+  template <typename T>
+  constexpr const char* GemmTypeName()
+  {
+    if constexpr (std::is_same_v<T,double>) return "double";
+    else if constexpr (std::is_same_v<T,float>) return "float";
+    else return nullptr;
+  }
+
+  inline std::string HostName()
+  {
+#ifdef _WIN32
+    const char* name = std::getenv("COMPUTERNAME");
+    return name ? name : "localhost";
+#else
+    char name[256] = "";
+    if (gethostname (name, sizeof(name)-1) != 0 || name[0] == 0)
+      return "localhost";
+    return name;
+#endif
+  }
+
+  inline std::string GemmProfilePath()
+  {
+    if (const char* env = std::getenv("NANOBLAS_TUNE_FILE"))
+      return env;
+    std::filesystem::path dir;
+    if (const char* xdg = std::getenv("XDG_CONFIG_HOME"))
+      dir = xdg;
+    else if (const char* home = std::getenv("HOME"))
+      dir = std::filesystem::path(home) / ".config";
+    else if (const char* profile = std::getenv("USERPROFILE"))
+      dir = std::filesystem::path(profile) / ".config";
+    else
+      dir = ".";
+    return (dir / "nanoblas" / (HostName() + ".tune")).string();
+  }
+
+  // entry of the profile for the kernels in use, "double avx512"
+  template <typename T>
+  std::string GemmProfileKey()
+  {
+    return std::string(GemmTypeName<T>()) + " " + ISAName(Kernels<T>().isa);
+  }
+
+  // parameters for T from a profile file, if there is a valid entry
+  template <typename T>
+  std::optional<GemmParams> LoadGemmParams (const std::string& path = GemmProfilePath())
+  {
+    if constexpr (GemmTypeName<T>() == nullptr)
+      return std::nullopt;
+    else
+      {
+        std::ifstream in(path);
+        std::string key = GemmProfileKey<T>(), line;
+        while (std::getline (in, line))
+          {
+            std::istringstream words(line);
+            std::string type, isa, word;
+            if (!(words >> type >> isa) || type+" "+isa != key) continue;
+
+            size_t mr = 0, nr = 0;
+            GemmParams par;
+            while (words >> word && word[0] != '#')
+              {
+                auto pos = word.find('=');
+                if (pos == std::string::npos) break;
+                std::string name = word.substr(0, pos);
+                size_t value = std::strtoul (word.c_str()+pos+1, nullptr, 10);
+                if (name == "mr") mr = value;
+                else if (name == "nr") nr = value;
+                else if (name == "mc") par.mc = value;
+                else if (name == "kc") par.kc = value;
+                else if (name == "nc") par.nc = value;
+              }
+
+            // the tile must still exist in the kernels
+            auto & tiles = Kernels<T>().gemm;
+            for (size_t t = 0; t < GEMM_TILES; t++)
+              if (tiles[t].mr == mr && tiles[t].nr == nr && par.mc && par.kc && par.nc)
+                {
+                  par.tile = t;
+                  return par;
+                }
+          }
+        return std::nullopt;
+      }
+  }
+
+  // replaces the entry for T in a profile file, false if it cannot be written
+  template <typename T>
+  bool SaveGemmParams (const GemmParams& par, const std::string& path = GemmProfilePath(),
+                       const std::string& comment = "")
+  {
+    static_assert (GemmTypeName<T>() != nullptr, "only float and double are tuned");
+    namespace fs = std::filesystem;
+    std::string key = GemmProfileKey<T>();
+
+    std::vector<std::string> lines;
+    {
+      std::ifstream in(path);
+      std::string line;
+      while (std::getline (in, line))
+        {
+          std::istringstream words(line);
+          std::string type, isa;
+          if ((words >> type >> isa) && type+" "+isa == key) continue;
+          lines.push_back (line);
+        }
+    }
+    if (lines.empty())
+      lines.push_back ("# nanoblas GEMM parameters of host " + HostName());
+
+    auto & tile = Kernels<T>().gemm[std::min(par.tile, GEMM_TILES-1)];
+    std::ostringstream entry;
+    entry << key << " mr=" << tile.mr << " nr=" << tile.nr
+          << " mc=" << par.mc << " kc=" << par.kc << " nc=" << par.nc;
+    if (!comment.empty()) entry << " # " << comment;
+    lines.push_back (entry.str());
+
+    // write a temporary file and rename it, readers never see a partial profile
+    std::error_code err;
+    fs::path file(path);
+    if (file.has_parent_path())
+      fs::create_directories (file.parent_path(), err);
+    fs::path tmp = file;
+    tmp += ".tmp" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+    {
+      std::ofstream out(tmp);
+      for (auto & line : lines)
+        out << line << "\n";
+      if (!out) return false;
+    }
+    fs::rename (tmp, file, err);
+    if (err) fs::remove (tmp, err);
+    return !err;
+  }
+
+
+  // ************************* tuning *******************
+
+  struct GemmTuneResult
+  {
+    GemmParams par;
+    double gflops;
+  };
+
+  /*
+    Benchmarks candidate parameters by coordinate search: micro-tile,
+    then KC, MC, and NC for a wide product. A candidate replaces the
+    best so far only if it is more than 1% faster, which keeps the
+    defaults if differences are within noise. Runs with the current
+    number of threads, taking a few seconds (quick: below a second).
+  */
+  template <typename T>
+  GemmTuneResult TuneGemm (bool quick = false, std::ostream* log = nullptr)
+  {
+    size_t nsq = quick ? 480 : 960;                // square products
+    size_t mwide = quick ? 256 : 384, nwide = quick ? 4096 : 8192;
+    size_t reps = quick ? 2 : 3;
+
+    size_t len = std::max(nsq*nsq, mwide*nwide);
+    std::vector<T> a(len), b(len), c(len, T(0));
+    for (size_t i = 0; i < len; i++)
+      {
+        a[i] = T(1) / T(1 + i%17);
+        b[i] = T(i%5) - T(2);
+      }
+
+    // best of reps runs, in GFlop/s
+    auto rate = [&] (const GemmParams& par, size_t m, size_t n, size_t k)
+    {
+      double best = 0;
+      for (size_t r = 0; r <= reps; r++)
+        {
+          auto start = std::chrono::steady_clock::now();
+          GemmKernel<T> (m, n, k, T(1e-3), a.data(), k, 1, b.data(), n, 1, c.data(), n, 1, par);
+          double t = std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+          if (r > 0)                                 // the first run warms up
+            best = std::max(best, 2.0*m*n*k / t * 1e-9);
+        }
+      return best;
+    };
+
+    auto & tiles = Kernels<T>().gemm;
+    auto report = [&] (const GemmParams& par, double gflops)
+    {
+      if (!log) return;
+      *log << "  tile " << std::setw(2) << tiles[par.tile].mr << "x" << std::setw(2) << tiles[par.tile].nr
+           << "  mc " << std::setw(4) << par.mc << "  kc " << std::setw(4) << par.kc
+           << "  nc " << std::setw(5) << par.nc << "  " << std::setw(8) << std::fixed
+           << std::setprecision(2) << gflops << std::defaultfloat << " GFlop/s" << std::endl;
+    };
+
+    GemmParams best;
+    double bestrate = 0;
+    auto trial = [&] (GemmParams par, size_t m, size_t n, size_t k)
+    {
+      par.mc = std::max(par.mc / tiles[par.tile].mr, size_t(1)) * tiles[par.tile].mr;
+      double r = rate (par, m, n, k);
+      report (par, r);
+      if (r > 1.01 * bestrate)
+        {
+          best = par;
+          bestrate = r;
+        }
+    };
+
+    trial (best, nsq, nsq, nsq);
+    for (size_t t = 1; t < GEMM_TILES; t++)
+      {
+        GemmParams par = best;
+        par.tile = t;
+        trial (par, nsq, nsq, nsq);
+      }
+    for (size_t kc : { 128, 192, 256, 384, 512 })
+      if (kc != best.kc)
+        {
+          GemmParams par = best;
+          par.kc = kc;
+          trial (par, nsq, nsq, nsq);
+        }
+    for (size_t mc : { 48, 96, 144, 192, 288 })
+      if (mc != best.mc)
+        {
+          GemmParams par = best;
+          par.mc = mc;
+          trial (par, nsq, nsq, nsq);
+        }
+    double squarerate = bestrate;
+
+    // NC matters only for products wider than NC
+    bestrate = 0;
+    trial (best, mwide, nwide, mwide);
+    for (size_t nc : { 1024, 2048, 4096, 8192 })
+      if (nc != best.nc)
+        {
+          GemmParams par = best;
+          par.nc = nc;
+          trial (par, mwide, nwide, mwide);
+        }
+
+    return { best, squarerate };
+  }
+
+
+  // ************************* parameters in use *******************
+
+  // from the profile, tuned if requested by NANOBLAS_TUNE, or the defaults
+  template <typename T>
+  GemmParams InitialGemmParams()
+  {
+    if constexpr (GemmTypeName<T>() == nullptr)
+      return GemmParams();
+    else
+      {
+        std::string path = GemmProfilePath();
+        if (auto par = LoadGemmParams<T> (path))
+          return *par;
+
+        const char* env = std::getenv("NANOBLAS_TUNE");
+        if (!env || std::atoi(env) <= 0)
+          return GemmParams();
+
+        std::cerr << "nanoblas: tuning GEMM for " << GemmProfileKey<T>() << std::endl;
+        auto res = TuneGemm<T>();
+        std::ostringstream comment;
+        comment << std::setprecision(4) << res.gflops << " GFlop/s, " << GetNumThreads() << " threads";
+        if (!SaveGemmParams<T> (res.par, path, comment.str()))
+          std::cerr << "nanoblas: cannot write tuning profile " << path << std::endl;
+        return res.par;
+      }
+  }
+
+  /*
+    The parameters are read by every product, so Get does not lock: it
+    copies the current snapshot, published by an atomic pointer. Set
+    publishes a new snapshot, old ones stay alive since readers may still
+    copy them; a few bytes per call of SetGemmParameters.
+  */
+  template <typename T>
+  class GemmParamStore
+  {
+    std::mutex m_mutex;
+    std::deque<GemmParams> m_snapshots { InitialGemmParams<T>() };
+    std::atomic<const GemmParams*> m_current { &m_snapshots.back() };
+  public:
+    static GemmParamStore& Instance()
+    {
+      static GemmParamStore store;
+      return store;
+    }
+    GemmParams Get() const
+    {
+      return *m_current.load(std::memory_order_acquire);
+    }
+    void Set (const GemmParams& par)
+    {
+      std::lock_guard<std::mutex> guard(m_mutex);
+      m_snapshots.push_back(par);
+      m_current.store(&m_snapshots.back(), std::memory_order_release);
+    }
+  };
+
+  template <typename T>
+  GemmParams GemmParameters() { return GemmParamStore<T>::Instance().Get(); }
+
+  // e.g. the result of TuneGemm, used by all following products
+  template <typename T>
+  void SetGemmParameters (const GemmParams& par) { GemmParamStore<T>::Instance().Set(par); }
+
+}
+
+#endif
@@ -4,6 +4,10 @@
 #include<complex>
 #include<cassert>
 #include <type_traits>
+#include <cstdint>
+
+#include "simd.hpp"
+#include "taskmanager.hpp"
 
 namespace nanoblas
 {
@@ -22,11 +26,98 @@ namespace nanoblas
   class VecExpr
   {
   public:
-    auto derived() const { return static_cast<const T&> (*this); }
+    const T& derived() const { return static_cast<const T&> (*this); }
     size_t size() const { return derived().size(); }
     auto operator() (size_t i) const { return derived()(i); }
   };
 
+
+  /*
+    How an expression node stores its operands:
+    views and expression nodes are cheap and stored by value,
+    owning containers with inline storage (like Vec) are stored by reference.
+  */
+  
+  template <typename T>
+  struct expr_storage { using type = T; };
+
+  template <typename T>
+  using expr_storage_t = typename expr_storage<T>::type;
+
+
+  /*
+    Besides element access e(i), expressions may provide a SIMD protocol:
+    e.template Get<W>(i) returns entries i, ..., i+W-1 as SIMD<elemtype,W>.
+    An expression sets SIMD_EVAL = true if Get is available and all its
+    leaves are contiguous, assignment then evaluates W entries at once.
+  */
+
+  template <typename TE>
+  using elem_t = std::remove_cvref_t<decltype(std::declval<const TE&>()(size_t(0)))>;
+
+  // minimal number of vector entries handled by one task
+  constexpr size_t VEC_PARALLEL_GRAIN = 1 << 16;
+  
+  template <typename TE>
+  constexpr bool SimdEval()
+  {
+    if constexpr (requires { std::remove_cvref_t<TE>::SIMD_EVAL; })
+      return std::remove_cvref_t<TE>::SIMD_EVAL;
+    else
+      return false;
+  }
+
+  
+
+  /*
+    Alias analysis for assignments
+
+    MemoryRange describes the memory of the target view. An expression
+    overlaps it if it reads from there, except entry by entry from the
+    very same view (like x = x + y), which is safe in place.
+    Expressions implement Overlaps(range, entrywise), products pass
+    entrywise = false to their operands.
+  */
+
+  struct MemoryRange
+  {
+    uintptr_t first = 0, next = 0;   // bytes [first, next)
+    uintptr_t data = 0;              // the view: data pointer and distances
+    size_t rs = 0, cs = 0;
+
+    // rows x cols entries of size bytes with row- and column-distance rs, cs
+    template <typename T>
+    static MemoryRange Of (const T* data, size_t rows, size_t cols, size_t rs, size_t cs)
+    {
+      MemoryRange r;
+      r.data = r.first = r.next = reinterpret_cast<uintptr_t>(data);
+      r.rs = rs;
+      r.cs = cs;
+      if (rows > 0 && cols > 0)
+        r.next = r.first + ((rows-1)*rs + (cols-1)*cs + 1) * sizeof(T);
+      return r;
+    }
+
+    bool Intersects (const MemoryRange& r) const { return first < r.next && r.first < next; }
+    bool SameView (const MemoryRange& r) const { return data == r.data && rs == r.rs && cs == r.cs; }
+
+    // a leaf with memory *this read by the expression
+    bool LeafOverlaps (const MemoryRange& target, bool entrywise) const
+    {
+      return Intersects(target) && !(entrywise && SameView(target));
+    }
+  };
+
+  // expressions without alias information are assumed to overlap
+  template <typename TE>
+  bool ExprOverlaps (const TE& e, const MemoryRange& target, bool entrywise)
+  {
+    if constexpr (requires { e.Overlaps(target, entrywise); })
+      return e.Overlaps(target, entrywise);
+    else
+      return true;
+  }
+
   
 
   // ************************ SumVecExpr *********************
@@ -38,8 +129,18 @@ namespace nanoblas
     TB b;
   public:
     SumVecExpr (TA _a, TB _b) : a(_a), b(_b) { }
+    const TA& A() const { return a; }
+    const TB& B() const { return b; }
+
+    static constexpr bool SIMD_EVAL =
+      SimdEval<TA>() && SimdEval<TB>() && std::is_same_v<elem_t<TA>,elem_t<TB>>;
+    
+    bool Overlaps (const MemoryRange& t, bool entrywise) const
+    { return ExprOverlaps(a, t, entrywise) || ExprOverlaps(b, t, entrywise); }
 
     auto operator() (size_t i) const { return a(i)+b(i); }
+    template <size_t W>
+    auto Get (size_t i) const { return a.template Get<W>(i)+b.template Get<W>(i); }
     size_t size() const { return a.size(); }      
   };
   
@@ -47,7 +148,7 @@ namespace nanoblas
   auto operator+ (const VecExpr<TA>& a, const VecExpr<TB>& b)
   {
     assert(a.size()==b.size());
-    return SumVecExpr(a.derived(), b.derived());
+    return SumVecExpr<expr_storage_t<TA>,expr_storage_t<TB>>(a.derived(), b.derived());
   }
 
 
@@ -61,7 +162,15 @@ namespace nanoblas
   public:
     SubVecExpr (TA _a, TB _b) : a(_a), b(_b) { }
 
+    static constexpr bool SIMD_EVAL =
+      SimdEval<TA>() && SimdEval<TB>() && std::is_same_v<elem_t<TA>,elem_t<TB>>;
+    
+    bool Overlaps (const MemoryRange& t, bool entrywise) const
+    { return ExprOverlaps(a, t, entrywise) || ExprOverlaps(b, t, entrywise); }
+
     auto operator() (size_t i) const { return a(i)-b(i); }
+    template <size_t W>
+    auto Get (size_t i) const { return a.template Get<W>(i)-b.template Get<W>(i); }
     size_t size() const { return a.size(); }      
   };
   
@@ -69,7 +178,7 @@ namespace nanoblas
   auto operator- (const VecExpr<TA>& a, const VecExpr<TB>& b)
   {
     assert(a.size()==b.size());    
-    return SubVecExpr(a.derived(), b.derived());
+    return SubVecExpr<expr_storage_t<TA>,expr_storage_t<TB>>(a.derived(), b.derived());
   }
 
 
@@ -83,14 +192,21 @@ namespace nanoblas
   public:
     NegVecExpr (TA _a) : a(_a) { }
 
+    static constexpr bool SIMD_EVAL = SimdEval<TA>();
+    
+    bool Overlaps (const MemoryRange& t, bool entrywise) const
+    { return ExprOverlaps(a, t, entrywise); }
+
     auto operator() (size_t i) const { return -a(i); }
+    template <size_t W>
+    auto Get (size_t i) const { return -a.template Get<W>(i); }
     size_t size() const { return a.size(); }      
   };
   
   template <typename TA>
   auto operator- (const VecExpr<TA>& a)
   {
-    return NegVecExpr(a.derived());
+    return NegVecExpr<expr_storage_t<TA>>(a.derived());
   }
 
 
@@ -119,7 +235,20 @@ namespace nanoblas
     TV vec;
   public:
     ScaleVecExpr (TSCAL _scal, TV _vec) : scal(_scal), vec(_vec) { }
+    TSCAL Scal() const { return scal; }
+    const TV& Expr() const { return vec; }
+
+    // the scalar is converted to the element type of the vector
+    static constexpr bool SIMD_EVAL =
+      SimdEval<TV>() && std::is_same_v<decltype(std::declval<TSCAL>()*std::declval<elem_t<TV>>()), elem_t<TV>>;
+    
+    bool Overlaps (const MemoryRange& t, bool entrywise) const
+    { return ExprOverlaps(vec, t, entrywise); }
+
     auto operator() (size_t i) const { return scal*vec(i); }
+    template <size_t W>
+    auto Get (size_t i) const
+    { return SIMD<elem_t<TV>,W>(elem_t<TV>(scal)) * vec.template Get<W>(i); }
     size_t size() const { return vec.size(); }      
   };
 
@@ -132,7 +261,7 @@ namespace nanoblas
   template <typename TSCAL, typename T> requires (isScalar<TSCAL>())
   auto operator* (TSCAL scal, const VecExpr<T>& v)
   {
-    return ScaleVecExpr(scal, v.derived());
+    return ScaleVecExpr<TSCAL,expr_storage_t<T>>(scal, v.derived());
   }
 
 
@@ -147,10 +276,13 @@ namespace nanoblas
     using elemtypeB = typename std::invoke_result<TB,size_t>::type;
     using TSUM = decltype(std::declval<elemtypeA>()*std::declval<elemtypeB>());
 
-    TSUM sum = 0;
-    for (size_t i = 0; i < a.size(); i++)
-      sum += a(i)*b(i);
-    return sum;
+    return ParallelReduce (a.size(), [&a,&b] (size_t first, size_t next)
+    {
+      TSUM sum = 0;
+      for (size_t i = first; i < next; i++)
+        sum += a(i)*b(i);
+      return sum;
+    }, TSUM(0), std::plus<TSUM>(), VEC_PARALLEL_GRAIN);
   }
 
 
@@ -166,9 +298,13 @@ namespace nanoblas
   {
     using elemtype = typename std::remove_cvref<typename std::invoke_result<TA,size_t>::type>::type;
 
-    elemtype sum = 0;
-    for (size_t i = 0; i < a.size(); i++)
-      sum += norm2(a(i));
+    elemtype sum = ParallelReduce (a.size(), [&a] (size_t first, size_t next)
+    {
+      elemtype sum = 0;
+      for (size_t i = first; i < next; i++)
+        sum += norm2(a(i));
+      return sum;
+    }, elemtype(0), std::plus<elemtype>(), VEC_PARALLEL_GRAIN);
     return sqrt(sum);
   }
 
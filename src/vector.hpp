@@ -3,8 +3,14 @@
 
 #include <iostream>
 #include <vector>
+#include <array>
+#include <tuple>
 
 #include "vecexpr.hpp"
+#include "kernels.hpp"
+#include "allocator.hpp"
+#include "blas.hpp"
+#include "profiler.hpp"
 
 
 namespace nanoblas
@@ -15,6 +21,37 @@ namespace nanoblas
   template <typename T, ORDERING ORD = RowMajor>
   class MatrixView;
 
+  template <typename T, typename TALLOC>
+  class Vector;
+
+
+  /*
+    Vector expressions evaluated by special kernels, see matrix.hpp:
+      vecview_pattern       x, s*x      -> (s, x)
+      gemv_pattern          s*A*x       -> (s, A, x)
+      gemv_update_pattern   s*A*x + t*y -> (s, A, x, t, y)
+  */
+  template <typename TE, typename T>
+  struct vecview_pattern : std::false_type { };
+
+  template <typename TE, typename T>
+  struct gemv_pattern : std::false_type { };
+
+  template <typename TE, typename T>
+  struct gemv_update_pattern : std::false_type { };
+
+
+  // y += alpha * x for contiguous vectors, by the axpy kernel
+  template <typename T>
+  void AxpyKernel (size_t n, T alpha, const T* x, T* y)
+  {
+    auto kernel = Kernels<T>().axpy;
+    ParallelForRange (n, [=] (size_t first, size_t next)
+    {
+      kernel (next-first, alpha, x+first, y+first);
+    }, VEC_PARALLEL_GRAIN);
+  }
+
 
   
   template <typename T=double, typename TDIST = std::integral_constant<size_t,1> >
@@ -38,19 +75,85 @@ namespace nanoblas
     
     VectorView (size_t size, TDIST dist, T* data)
       : m_data(data), m_size(size), m_dist(dist) { }
+
+    static constexpr bool SIMD_EVAL = std::is_same_v<TDIST, std::integral_constant<size_t,1>>;
     
     VectorView operator= (const VectorView& v2)
     {
-      for (size_t i = 0; i < m_size; i++)
-        m_data[m_dist*i] = v2(i);
-      return *this;
+      return *this = static_cast<const VecExpr<VectorView>&>(v2);
     }
 
+    // memory of the vector, for alias analysis
+    MemoryRange Range() const { return MemoryRange::Of(m_data, m_size, 1, size_t(m_dist), 0); }
+    bool Overlaps (const MemoryRange& t, bool entrywise) const { return Range().LeafOverlaps(t, entrywise); }
+
+    // assignments evaluate via a temporary if the expression reads this vector
     template <typename TB>
     VectorView operator= (const VecExpr<TB>& v2)
     {
-      for (size_t i = 0; i < m_size; i++)
-        m_data[m_dist*i] = v2(i);
+      if (ExprOverlaps(v2.derived(), Range(), true))
+        return AssignNoAlias(Vector<T,AlignedAllocator<T>>(v2));
+      return AssignNoAlias(v2);
+    }
+
+    template <typename TB>
+    VectorView& operator+= (const VecExpr<TB>& v2)
+    {
+      if (ExprOverlaps(v2.derived(), Range(), true))
+        return AddNoAlias(Vector<T,AlignedAllocator<T>>(v2));
+      return AddNoAlias(v2);
+    }
+
+    template <typename TB>
+    VectorView& operator-= (const VecExpr<TB>& v2)
+    {
+      if (ExprOverlaps(v2.derived(), Range(), true))
+        return SubNoAlias(Vector<T,AlignedAllocator<T>>(v2));
+      return SubNoAlias(v2);
+    }
+
+    template <typename TB>
+    VectorView& AssignNoAlias (const VecExpr<TB>& v2)
+    {
+      // y = s*A*x and y = s*A*x + t*y by the matrix-vector kernel
+      if constexpr (gemv_pattern<TB,T>::value)
+        {
+          auto [s, a, x] = gemv_pattern<TB,T>::Split(v2.derived());
+          *this = T(0);
+          AddMultMatVec (s, a, x, *this);
+          return *this;
+        }
+      else if constexpr (gemv_update_pattern<TB,T>::value)
+        {
+          auto [s, a, x, t, y] = gemv_update_pattern<TB,T>::Split(v2.derived());
+          if (y.data() == m_data && size_t(y.dist()) == size_t(m_dist))
+            {
+              if (t == T(0))
+                *this = T(0);
+              else if (t != T(1))
+                *this *= t;
+              AddMultMatVec (s, a, x, *this);
+              return *this;
+            }
+        }
+
+      NANOBLAS_PROFILE_KERNEL("vec_assign", 0, m_size*sizeof(T));
+      ParallelForRange (m_size, [this,&v2] (size_t first, size_t next)
+      {
+        if constexpr (SIMD_EVAL && SimdEval<TB>() && std::is_same_v<elem_t<TB>,T>)
+          {
+            constexpr size_t W = SimdWidth<T>();
+            const auto& e = v2.derived();
+            size_t i = first;
+            for ( ; i+W <= next; i += W)
+              e.template Get<W>(i).Store(m_data+i);
+            for ( ; i < next; i++)
+              m_data[i] = e(i);
+          }
+        else
+          for (size_t i = first; i < next; i++)
+            m_data[m_dist*i] = v2(i);
+      }, VEC_PARALLEL_GRAIN);
       return *this;
     }
 
@@ -85,6 +188,20 @@ namespace nanoblas
     
     T& operator[](size_t i) { return m_data[m_dist*i]; }
     const T& operator[](size_t i) const { return m_data[m_dist*i]; }
+
+    template <size_t W>
+    SIMD<T,W> Get (size_t i) const
+    {
+      if constexpr (SIMD_EVAL)
+        return SIMD<T,W>(m_data+i);
+      else
+        {
+          T vals[W];
+          for (size_t k = 0; k < W; k++)
+            vals[k] = m_data[m_dist*(i+k)];
+          return SIMD<T,W>(vals);
+        }
+    }
     
     auto range(size_t first, size_t next) const {
       return VectorView(next-first, m_dist, m_data+first*m_dist);
@@ -99,18 +216,88 @@ namespace nanoblas
     }
     
     template <typename TB>
-    VectorView& operator+= (const VecExpr<TB>& v2)
+    VectorView& AddNoAlias (const VecExpr<TB>& v2)
     {
-      for (size_t i = 0; i < m_size; i++)
-        m_data[m_dist*i] += v2(i);
+      if constexpr (gemv_pattern<TB,T>::value)
+        {
+          auto [s, a, x] = gemv_pattern<TB,T>::Split(v2.derived());
+          AddMultMatVec (s, a, x, *this);
+          return *this;
+        }
+      else if constexpr (vecview_pattern<TB,T>::value)
+        {
+          auto [s, x] = vecview_pattern<TB,T>::Split(v2.derived());
+          if (BlasAxpy (m_size, s, x.data(), size_t(x.dist()), m_data, size_t(m_dist)))
+            return *this;
+          if constexpr (std::is_floating_point_v<T>)
+            if (size_t(x.dist()) == 1 && size_t(m_dist) == 1)
+              {
+                NANOBLAS_PROFILE_KERNEL("axpy", 2*m_size, 3*m_size*sizeof(T));
+                AxpyKernel (m_size, s, x.data(), m_data);
+                return *this;
+              }
+        }
+
+      NANOBLAS_PROFILE_KERNEL("vec_update", m_size, 2*m_size*sizeof(T));
+      ParallelForRange (m_size, [this,&v2] (size_t first, size_t next)
+      {
+        if constexpr (SIMD_EVAL && SimdEval<TB>() && std::is_same_v<elem_t<TB>,T>)
+          {
+            constexpr size_t W = SimdWidth<T>();
+            const auto& e = v2.derived();
+            size_t i = first;
+            for ( ; i+W <= next; i += W)
+              (SIMD<T,W>(m_data+i) + e.template Get<W>(i)).Store(m_data+i);
+            for ( ; i < next; i++)
+              m_data[i] += e(i);
+          }
+        else
+          for (size_t i = first; i < next; i++)
+            m_data[m_dist*i] += v2(i);
+      }, VEC_PARALLEL_GRAIN);
       return *this;
     }
 
     template <typename TB>
-    VectorView& operator-= (const VecExpr<TB>& v2)
+    VectorView& SubNoAlias (const VecExpr<TB>& v2)
       {
-        for (size_t i = 0; i < m_size; i++)
-          m_data[m_dist*i] -= v2(i);
+        if constexpr (gemv_pattern<TB,T>::value)
+          {
+            auto [s, a, x] = gemv_pattern<TB,T>::Split(v2.derived());
+            AddMultMatVec (-s, a, x, *this);
+            return *this;
+          }
+        else if constexpr (vecview_pattern<TB,T>::value)
+          {
+            auto [s, x] = vecview_pattern<TB,T>::Split(v2.derived());
+            if (BlasAxpy (m_size, -s, x.data(), size_t(x.dist()), m_data, size_t(m_dist)))
+              return *this;
+            if constexpr (std::is_floating_point_v<T>)
+              if (size_t(x.dist()) == 1 && size_t(m_dist) == 1)
+                {
+                  NANOBLAS_PROFILE_KERNEL("axpy", 2*m_size, 3*m_size*sizeof(T));
+                  AxpyKernel (m_size, -s, x.data(), m_data);
+                  return *this;
+                }
+          }
+
+        NANOBLAS_PROFILE_KERNEL("vec_update", m_size, 2*m_size*sizeof(T));
+        ParallelForRange (m_size, [this,&v2] (size_t first, size_t next)
+        {
+          if constexpr (SIMD_EVAL && SimdEval<TB>() && std::is_same_v<elem_t<TB>,T>)
+            {
+              constexpr size_t W = SimdWidth<T>();
+              const auto& e = v2.derived();
+              size_t i = first;
+              for ( ; i+W <= next; i += W)
+                (SIMD<T,W>(m_data+i) - e.template Get<W>(i)).Store(m_data+i);
+              for ( ; i < next; i++)
+                m_data[i] -= e(i);
+            }
+          else
+            for (size_t i = first; i < next; i++)
+              m_data[m_dist*i] -= v2(i);
+        }, VEC_PARALLEL_GRAIN);
         return *this;
       }
 
@@ -126,7 +313,72 @@ namespace nanoblas
   
 
   
-  template <typename T=double>
+  template <typename T, typename TDIST>
+  struct vecview_pattern<VectorView<T,TDIST>, T> : std::true_type
+  {
+    static auto Split (const VectorView<T,TDIST>& x) { return std::tuple(T(1), x); }
+  };
+
+  template <typename TSCAL, typename TV, typename T>
+    requires (vecview_pattern<TV,T>::value && std::is_convertible_v<TSCAL,T>)
+  struct vecview_pattern<ScaleVecExpr<TSCAL,TV>, T> : std::true_type
+  {
+    static auto Split (const ScaleVecExpr<TSCAL,TV>& e)
+    {
+      auto [s, x] = vecview_pattern<TV,T>::Split(e.Expr());
+      return std::tuple(T(e.Scal())*s, x);
+    }
+  };
+
+
+  // dot product of scaled contiguous vectors by the dot kernel
+  template <typename TA, typename TB>
+    requires (std::is_floating_point_v<elem_t<TA>> && std::is_same_v<elem_t<TA>, elem_t<TB>> &&
+              vecview_pattern<TA,elem_t<TA>>::value && vecview_pattern<TB,elem_t<TA>>::value)
+  auto dot (const VecExpr<TA>& a, const VecExpr<TB>& b)
+  {
+    assert (a.size() == b.size());
+    using T = elem_t<TA>;
+    auto [sa, x] = vecview_pattern<TA,T>::Split(a.derived());
+    auto [sb, y] = vecview_pattern<TB,T>::Split(b.derived());
+
+    if (size_t(x.dist()) != 1 || size_t(y.dist()) != 1)
+      return sa*sb * ParallelReduce (x.size(), [x=x, y=y] (size_t first, size_t next)
+      {
+        T sum = 0;
+        for (size_t i = first; i < next; i++)
+          sum += x(i)*y(i);
+        return sum;
+      }, T(0), std::plus<T>(), VEC_PARALLEL_GRAIN);
+
+    auto kernel = Kernels<T>().dot;
+    return sa*sb * ParallelReduce (x.size(), [kernel, px=x.data(), py=y.data()] (size_t first, size_t next)
+    {
+      return kernel (next-first, px+first, py+first);
+    }, T(0), std::plus<T>(), VEC_PARALLEL_GRAIN);
+  }
+
+
+  /*
+    noalias(y) = expr, and +=, -=, skip the alias check. The caller
+    guarantees that expr reads y at most entry by entry.
+  */
+  template <typename TV>
+  class NoAlias
+  {
+    TV m_view;
+  public:
+    explicit NoAlias (TV view) : m_view(view) { }
+    template <typename TB> TV& operator= (const TB& e) { return m_view.AssignNoAlias(e); }
+    template <typename TB> TV& operator+= (const TB& e) { return m_view.AddNoAlias(e); }
+    template <typename TB> TV& operator-= (const TB& e) { return m_view.SubNoAlias(e); }
+  };
+
+  template <typename T, typename TDIST>
+  auto noalias (VectorView<T,TDIST> v) { return NoAlias<VectorView<T,TDIST>>(v); }
+
+
+  template <typename T=double, typename TALLOC=AlignedAllocator<T>>
   class Vector : public VectorView<T>
   {
     typedef VectorView<T> BASE;
@@ -134,7 +386,7 @@ namespace nanoblas
     using BASE::m_data;
   public:
     explicit Vector (size_t size) 
-      : VectorView<T> (size, new T[size]) { ; }
+      : VectorView<T> (size, TALLOC::Allocate(size)) { ; }
     
     Vector (const Vector& v)
       : Vector(v.size())
@@ -158,14 +410,14 @@ namespace nanoblas
 
   
     Vector (std::initializer_list<T> list) 
-      : VectorView<T> (list.size(), new T[list.size()])
+      : Vector (list.size())
     {
       size_t cnt = 0;
       for (auto val : list)
         (*this)(cnt++) = val;
     }
     
-    ~Vector () { delete [] m_data; }
+    ~Vector () { TALLOC::Deallocate(m_data, m_size); }
 
     using BASE::operator=;
     Vector& operator=(const Vector& v2)
@@ -233,18 +485,32 @@ namespace nanoblas
     template <typename TB>
     Vec& operator= (const VecExpr<TB>& v2)
     {
+      if (ExprOverlaps(v2.derived(), Range(), true))
+        return *this = Vec(v2);
       for (size_t i = 0; i < S; i++)
         m_data[i] = v2(i);
       return *this;
     }
     
+    static constexpr bool SIMD_EVAL = true;
+
+    MemoryRange Range() const { return MemoryRange::Of(m_data.data(), S, 1, 1, 0); }
+    bool Overlaps (const MemoryRange& t, bool entrywise) const { return Range().LeafOverlaps(t, entrywise); }
+    
     size_t size() const { return S; }
     std::array<T,S>& data() { return m_data; }
     const std::array<T,S>& data() const { return m_data; }
     
     T& operator() (size_t i) { return m_data[i]; }
     const T& operator() (size_t i) const { return m_data[i]; }
+
+    template <size_t W>
+    SIMD<T,W> Get (size_t i) const { return SIMD<T,W>(m_data.data()+i); }
  };
+
+  // Vec holds its values, expressions refer to it instead of copying
+  template <size_t S, typename T>
+  struct expr_storage<Vec<S,T>> { using type = const Vec<S,T>&; };
   
 }
 
@@ -0,0 +1,89 @@
+#include <iostream>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include <vector.hpp>
+#include <matrix.hpp>
+#include <inverse.hpp>
+
+using namespace nanoblas;
+
+
+/*
+  Expression templates must not allocate: operands enter expressions as
+  views, so building and evaluating x+3*y into existing storage costs no
+  heap allocation. Global operator new/delete count all allocations.
+*/
+
+static std::atomic<size_t> allocations{0};
+
+void* operator new (size_t size)
+{
+  allocations++;
+  if (void* p = std::malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+void* operator new[] (size_t size) { return operator new(size); }
+void operator delete (void* p) noexcept { std::free(p); }
+void operator delete[] (void* p) noexcept { std::free(p); }
+void operator delete (void* p, size_t) noexcept { std::free(p); }
+void operator delete[] (void* p, size_t) noexcept { std::free(p); }
+
+
+static int failures = 0;
+
+template <typename F>
+void ExpectNoAllocation (const char* name, F f)
+{
+  f();                                    // first call may set up thread-local buffers
+  size_t before = allocations.load();
+  f();
+  size_t count = allocations.load() - before;
+  std::cout << (count == 0 ? "ok    " : "FAIL  ") << name << ": " << count << " allocations" << std::endl;
+  if (count != 0) failures++;
+}
+
+
+int main()
+{
+  size_t n = 1000000;
+  Vector<double> x(n), y(n), z(n);
+  x = 1.0;
+  y = 2.0;
+
+  ExpectNoAllocation ("build x+3*y", [&] {
+    auto expr = x + 3*y;
+    if (expr.size() != n) failures++;
+  });
+  ExpectNoAllocation ("z = x+3*y", [&] { z = x + 3*y; });
+  ExpectNoAllocation ("z += x-y", [&] { z += x - y; });
+  if (z(0) != 5.0)                        // 1+3*2, then twice -1
+    {
+      std::cout << "FAIL  wrong value " << z(0) << std::endl;
+      failures++;
+    }
+
+  size_t m = 500;
+  Matrix<double> a(m,m), b(m,m), c(m,m);
+  a = 1.0;
+  b = 2.0;
+  ExpectNoAllocation ("build a+2*trans(b)", [&] {
+    auto expr = a + 2*trans(b);
+    if (expr.rows() != m) failures++;
+  });
+  ExpectNoAllocation ("c = a+2*trans(b)", [&] { c = a + 2*trans(b); });
+  if (c(1,2) != 5.0)
+    {
+      std::cout << "FAIL  wrong value " << c(1,2) << std::endl;
+      failures++;
+    }
+
+  // fixed size matrices live on the stack, also beyond the explicit formulas
+  Mat<6,6,double> s6(1.0), inv6;
+  for (size_t i = 0; i < 6; i++)
+    s6(i,i) = 10.0;
+  ExpectNoAllocation ("inverse of Mat<6,6>", [&] { inv6 = inverse(s6); });
+
+  return failures ? 1 : 0;
+}
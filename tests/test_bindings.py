@@ -0,0 +1,91 @@
+# Tests of the Python module, run by ctest with the module directory in PYTHONPATH
+
+import sys
+import numpy as np
+import nanoblas_impl as nb
+
+failures = 0
+
+def check(name, ok):
+    global failures
+    print(("ok    " if ok else "FAIL  ") + name)
+    if not ok:
+        failures += 1
+
+def vector(values):
+    v = nb.Vector(len(values))
+    for i, val in enumerate(values):
+        v[i] = val
+    return v
+
+
+# lincomb with out among the inputs, also several times
+n = 10000
+x = vector([1.0] * n)
+y = vector([2.0] * n)
+
+nb.lincomb([2, 3], [x, x], out=x)
+check("lincomb out twice in vecs", x[0] == 5 and x[n-1] == 5)
+
+x = vector([1.0] * n)
+nb.lincomb([2, 1, 3], [x, y, x], out=x)
+check("lincomb out first and last in vecs", x[0] == 7 and x[n-1] == 7)
+
+x = vector([1.0] * n)
+z = nb.lincomb([2, 1], [x, y])
+check("lincomb into a new vector", z[0] == 4 and x[0] == 1)
+
+
+# views of numpy arrays in the kernels, of both orderings and with strides
+xs = np.arange(10.0)
+ys = np.ones(20)
+vx = nb.asVector(xs)
+vy = nb.asVector(ys[::2])
+check("dot of views", nb.dot(vx, vy) == 45)
+check("dot of view and Vector", nb.dot(vx, nb.Vector(xs)) == np.dot(xs, xs))
+
+nb.axpy(2, vx, vy)
+check("axpy into a strided view", np.array_equal(ys[::2], 1 + 2*xs) and np.all(ys[1::2] == 1))
+
+xv = nb.Vector(xs)
+xv += nb.asVector(ys[::2])
+xv -= nb.asVector(xs)
+check("+= and -= of views", np.array_equal(np.asarray(xv), ys[::2]))
+
+buf = np.arange(20.0)
+expect = 2*buf[:10] + buf[5:15]
+nb.lincomb([1, 1, 1], [nb.asVector(buf[:10]), nb.asVector(buf[5:15]), nb.asVector(buf[:10])],
+           out=nb.asVector(buf[:10]))
+check("lincomb with overlapping views", np.array_equal(buf[:10], expect))
+
+rng = np.random.default_rng(1)
+a = rng.standard_normal((6, 4))
+b = rng.standard_normal((4, 5))
+for order_a in "CF":
+    for order_b in "CF":
+        for order_c in "CF":
+            ca = np.array(a, order=order_a)
+            cb = np.array(b, order=order_b)
+            cc = np.zeros((6, 5), order=order_c)
+            nb.MultMatMat(nb.asMatrix(ca), nb.asMatrix(cb), nb.asMatrix(cc))
+            check("MultMatMat " + order_a + order_b + order_c, np.allclose(cc, a @ b))
+
+check("view @ view", np.allclose(np.asarray(nb.asMatrix(a) @ nb.asMatrix(np.asfortranarray(b))), a @ b))
+check("Matrix @ view", np.allclose(np.asarray(nb.Matrix(a) @ nb.asMatrix(b)), a @ b))
+check("view @ vector view", np.allclose(np.asarray(nb.asMatrix(b) @ nb.asVector(xs[:5])), b @ xs[:5]))
+
+spd = a.T @ a + 4*np.eye(4)
+rhs = rng.standard_normal(4)
+rhs2 = np.asfortranarray(rng.standard_normal((4, 3)))
+for name, fact in [("LU", nb.LU), ("Cholesky", nb.Cholesky)]:
+    f = fact(nb.asMatrix(np.asfortranarray(spd)))
+    sol = rhs.copy()
+    f.solve(nb.asVector(sol))
+    check(name + " solve of a vector view", np.allclose(spd @ sol, rhs))
+    sol2 = rhs2.copy(order="F")
+    f.solve(nb.asMatrix(sol2))
+    check(name + " solve of a column major view", np.allclose(spd @ sol2, rhs2))
+
+check("gemm backend reported", nb.gemm_backend in ("blas", "native"))
+
+sys.exit(1 if failures else 0)
@@ -0,0 +1,92 @@
+#include <iostream>
+#include <cmath>
+
+#include <matrix.hpp>
+#include <inverse.hpp>
+
+using namespace nanoblas;
+
+
+/*
+  Fixed size matrices: inverse(Mat<N,N>) uses explicit formulas up to
+  3x3 and a stack-only elimination beyond, both are compared with the
+  dynamic calcInverse. The test matrices have small or zero diagonal
+  entries, so the elimination has to pivot. Updates of a Mat by
+  expressions reading it through views must match Matrix.
+*/
+
+static int failures = 0;
+
+template <size_t N>
+void CheckInverse ()
+{
+  Mat<N,N,double> a;
+  Matrix<double> dyn(N,N);
+  for (size_t i = 0; i < N; i++)
+    for (size_t j = 0; j < N; j++)
+      dyn(i,j) = a(i,j) = (i == j) ? 0.0 : 1.0 / (1.0 + i + 2*j) + ((i+j) % 3);
+
+  auto inv = inverse(a);
+  calcInverse<double> (dyn);
+
+  double err = 0, ident = 0;
+  auto prod = a * inv;
+  for (size_t i = 0; i < N; i++)
+    for (size_t j = 0; j < N; j++)
+      {
+        err = std::max(err, std::abs(inv(i,j) - dyn(i,j)));
+        ident = std::max(ident, std::abs(prod(i,j) - (i == j ? 1.0 : 0.0)));
+      }
+
+  bool ok = err < 1e-12 && ident < 1e-12;
+  std::cout << (ok ? "ok    " : "FAIL  ") << "inverse " << N << "x" << N
+            << ": |inv-calcInverse| = " << err << ", |a*inv-I| = " << ident << std::endl;
+  if (!ok) failures++;
+}
+
+
+// m += m*m and m -= trans(m), with m read through views, against Matrix
+void CheckUpdateAlias ()
+{
+  Mat<3,3,double> m;
+  Matrix<double> ref(3,3);
+  for (size_t i = 0; i < 3; i++)
+    for (size_t j = 0; j < 3; j++)
+      ref(i,j) = m(i,j) = 1.0 + i + 3*j;
+
+  m += m.view() * m.view();
+  ref += ref * ref;
+  m -= trans(m.view());
+  ref -= Matrix<double>(trans(ref));
+
+  double err = 0;
+  for (size_t i = 0; i < 3; i++)
+    for (size_t j = 0; j < 3; j++)
+      err = std::max(err, std::abs(m(i,j) - ref(i,j)));
+  bool ok = err == 0;
+  std::cout << (ok ? "ok    " : "FAIL  ") << "Mat += and -= reading itself: |m-ref| = " << err << std::endl;
+  if (!ok) failures++;
+}
+
+
+int main()
+{
+  CheckInverse<2>();
+  CheckInverse<3>();
+  CheckInverse<6>();
+  CheckUpdateAlias();
+
+  Mat<6,6,double> sing(1.0);
+  try
+    {
+      inverse(sing);
+      std::cout << "FAIL  inverse of a singular 6x6 matrix did not throw" << std::endl;
+      failures++;
+    }
+  catch (std::runtime_error&)
+    {
+      std::cout << "ok    singular 6x6 matrix throws" << std::endl;
+    }
+
+  return failures ? 1 : 0;
+}